@@ -69,40 +69,40 @@
 #else
 /*__KERNEL__ not defined i.e. userspace! */
 
-/*bwlq - byte/word/long/quad-word*/
-#define simeth_uio_rd(addr, bwlq) \
-	(*(volatile uint##bwlq##t *)(addr))
-#define simeth_uio_wr(addr, value, bwlq) \
-	(*(volatile uint##bwlq##_t *)(addr) = (uint##bwlq##_t)(value))
-
-#define simeth_r8(addr)            simeth_uio_rd (addr, b)
-#define simeth_r16(addr)           simeth_uio_rd (addr, w)
-#define simeth_r32(addr)           simeth_uio_rd (addr, l)
-#define simeth_r64(addr)           simeth_uio_rd (addr, q)
-
-#define simeth_w8(addr, value)     simeth_uio_wr (addr, b, value)
-#define simeth_w16(addr, value)    simeth_uio_wr (addr, w, value)
-#define simeth_w32(addr, value)    simeth_uio_wr (addr, l, value)
-#define simeth_w64(addr, value)    simeth_uio_wr (addr, q, value)
-
-#define simeth_uio_rd_rep(addr, buf, cnt, bwlq) \
+/*bits - 8/16/32/64 i.e. byte/word/long/quad-word*/
+#define simeth_uio_rd(addr, bits) \
+	(*(volatile uint##bits##_t *)(addr))
+#define simeth_uio_wr(addr, value, bits) \
+	(*(volatile uint##bits##_t *)(addr) = (uint##bits##_t)(value))
+
+#define simeth_r8(addr)            simeth_uio_rd (addr, 8)
+#define simeth_r16(addr)           simeth_uio_rd (addr, 16)
+#define simeth_r32(addr)           simeth_uio_rd (addr, 32)
+#define simeth_r64(addr)           simeth_uio_rd (addr, 64)
+
+#define simeth_w8(addr, value)     simeth_uio_wr (addr, value, 8)
+#define simeth_w16(addr, value)    simeth_uio_wr (addr, value, 16)
+#define simeth_w32(addr, value)    simeth_uio_wr (addr, value, 32)
+#define simeth_w64(addr, value)    simeth_uio_wr (addr, value, 64)
+
+#define simeth_uio_rd_rep(addr, buf, cnt, bits) \
 	memcpy ((void *)(buf), \
-			(const volatile void *)(addr), \
-			(cnt) * sizeof (uint##bwlq##_t))
-#define simeth_uio_wr_rep(addr, buf, cnt, bwlq) \
-	memcpy ((volatile void *)(addr), \
+			(const void *)(addr), \
+			(cnt) * sizeof (uint##bits##_t))
+#define simeth_uio_wr_rep(addr, buf, cnt, bits) \
+	memcpy ((void *)(addr), \
 			(const void *)(buf), \
-			(cnt) * sizeof (uint##bwlq##_t))
+			(cnt) * sizeof (uint##bits##_t))
 
-#define simeth_r8_rep(addr, buf, cnt)  simeth_uio_rd_rep (addr, buf, cnt, b)
-#define simeth_r16_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, w)
-#define simeth_r32_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, l)
-#define simeth_r64_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, q)
+#define simeth_r8_rep(addr, buf, cnt)  simeth_uio_rd_rep (addr, buf, cnt, 8)
+#define simeth_r16_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, 16)
+#define simeth_r32_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, 32)
+#define simeth_r64_rep(addr, buf, cnt) simeth_uio_rd_rep (addr, buf, cnt, 64)
 
-#define simeth_w8_rep(addr, buf, cnt)  simeth_uio_wr_rep (addr, buf, cnt, b)
-#define simeth_w16_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, w)
-#define simeth_w32_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, l)
-#define simeth_w64_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, q)
+#define simeth_w8_rep(addr, buf, cnt)  simeth_uio_wr_rep (addr, buf, cnt, 8)
+#define simeth_w16_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, 16)
+#define simeth_w32_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, 32)
+#define simeth_w64_rep(addr, buf, cnt) simeth_uio_wr_rep (addr, buf, cnt, 64)
 
 #endif /*#ifdef __KERNEL__*/
 
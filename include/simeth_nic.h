@@ -12,6 +12,34 @@
 
 #endif /*__KERNEL__*/
 
+/* (S)IM(E)TH BAR layout
+ * The shared BAR is the only memory the engine can reach, so registers,
+ * desc rings and packet buffers all live in it. Every q owns a fixed ring
+ * area and a fixed pool area of SER_BAR_BUF_SZ slots, txq n and rxq n
+ * side by side. Engine tx qs past SER_MAX_QS are the xdp tx qs of the
+ * driver, with their own register sets, rings and pools laid out the same
+ * way. Device addresses in descs/registers are BAR offsets */
+#define SER_BAR_SZ                 (512 * 1024 * 1024)
+#define SER_BAR_REGS_OFF           0x00000000
+#define SER_BAR_REGS_SZ            0x00010000
+#define SER_BAR_DRING_OFF          0x00010000
+#define SER_BAR_DRING_QSZ          0x00002000 /*room for 512 descs*/
+#define SER_BAR_POOL_OFF           0x00200000
+#define SER_BAR_POOL_QSZ           0x00200000 /*room for 1024 slots*/
+#define SER_BAR_BUF_SZ             2048
+#define SER_BAR_HDR_OFF            0x08000000 /*rxq header split buffers, past the pools*/
+#define SER_BAR_HDR_QSZ            0x00020000 /*SER_HDS_HDR_SZ per desc of 512*/
+#define SER_MAX_QS                 16
+#define SER_MAX_XDP_QS             SER_MAX_QS
+#define SER_MAX_TXQS               (SER_MAX_QS + SER_MAX_XDP_QS)
+#define SER_XDP_TXQ(n)             (SER_MAX_QS + (n)) /*engine tx q of xdp tx q n*/
+
+#define SER_BAR_TX_DRING(q)        (SER_BAR_DRING_OFF + (2 * (q)) * SER_BAR_DRING_QSZ)
+#define SER_BAR_RX_DRING(q)        (SER_BAR_DRING_OFF + (2 * (q) + 1) * SER_BAR_DRING_QSZ)
+#define SER_BAR_TX_POOL(q)         (SER_BAR_POOL_OFF + (2 * (q)) * SER_BAR_POOL_QSZ)
+#define SER_BAR_RX_POOL(q)         (SER_BAR_POOL_OFF + (2 * (q) + 1) * SER_BAR_POOL_QSZ)
+#define SER_BAR_RX_HDR(q)          (SER_BAR_HDR_OFF + (q) * SER_BAR_HDR_QSZ)
+
 /* (S)IM(E)TH 32-bit (R)egister Set */
 
 /*simeth device statistics RO only for driver!!!*/
@@ -34,6 +62,8 @@
 #define SER_TX_DRING_SZ            0x0108
 #define SER_TX_DRING_CTRL          0x0110
 #define SER_TX_DRING_ST            0x0114
+#define SER_TX_DRING_TAIL          0x0118
+#define SER_TX_DRING_HEAD          0x011c
 
 #define SER_RX_DRING_BASE          0x0200/*rx desc register set base-offset*/
 #define SER_RX_DRING_PA            0x0200
@@ -42,22 +72,143 @@
 #define SER_RX_DRING_SZ            0x0208
 #define SER_RX_DRING_CTRL          0x0210
 #define SER_RX_DRING_ST            0x0214
+#define SER_RX_DRING_TAIL          0x0218
+#define SER_RX_DRING_HEAD          0x021c
+
+/*q n's register sets, txq/rxq sets interleave every SER_DRING_QSTRIDE;
+ *q 0's are the SER_TX_DRING_BASE/SER_RX_DRING_BASE sets above*/
+#define SER_DRING_QSTRIDE          0x0200
+#define SER_TX_DRING_QBASE(q)      (SER_TX_DRING_BASE + (q) * SER_DRING_QSTRIDE)
+#define SER_RX_DRING_QBASE(q)      (SER_RX_DRING_BASE + (q) * SER_DRING_QSTRIDE)
+
+/*desc ring registers relative to a q's SER_TX_DRING_QBASE/SER_RX_DRING_QBASE*/
+#define SER_DRING_PA_L             0x0000
+#define SER_DRING_PA_H             0x0004
+#define SER_DRING_SZ               0x0008 /*number of descs in the ring*/
+#define SER_DRING_CTRL             0x0010
+#define SER_DRING_ST               0x0014
+#define SER_DRING_TAIL             0x0018 /*producer idx, written by driver*/
+#define SER_DRING_HEAD             0x001c /*consumer idx, written by engine*/
+#define SER_DRING_HDR_PA           0x0020 /*rxq: header buffers, SER_HDS_HDR_SZ per desc idx*/
+#define SER_DRING_IRQ_VEC          0x0024 /*msi-x vector signalled when head moves, or SER_IRQ_VEC_NONE*/
+#define SER_DRING_ITR_USECS        0x0028 /*irq moderation: signal at most this long after a frame, 0 right away*/
+#define SER_DRING_ITR_FRAMES       0x002c /*or once this many frames are done, 0 for no frame limit*/
 
 /*descq ctrl/status flags*/
 #define SER_DRING_EN               0x0001
 #define SER_DRING_RST              0x0002
 #define SER_DRING_EN               0x0001
 
+/*receive side scaling: engine hashes each rx frame with the key and
+ *picks its rxq from the indirection table; key and table are byte arrays*/
+#define SER_RSS_CTRL               0x4000
+#define SER_RSS_N_QS               0x4004 /*rx qs enabled, table entries past them are clamped*/
+#define SER_RSS_KEY                0x4040 /*SER_RSS_KEY_SZ bytes of Toeplitz key*/
+#define SER_RSS_RETA               0x4080 /*SER_RSS_RETA_SZ bytes, rxq of each hash & (SZ - 1)*/
+#define SER_RSS_KEY_SZ             40
+#define SER_RSS_RETA_SZ            128
+
+/*rss ctrl flags*/
+#define SER_RSS_EN                 0x0001 /*hash frames, else all go to rxq 0*/
+
+/*receive segment coalescing: engine merges in-order tcp segments of a flow
+ *into one rx frame, delivered when it'd outgrow max len, can't take the
+ *next segment, or has been held for flush usecs*/
+#define SER_RSC_CTRL               0x4200
+#define SER_RSC_MAX_LEN            0x4204 /*bytes of a merged frame, headers included*/
+#define SER_RSC_FLUSH_US           0x4208
+
+/*rsc ctrl flags*/
+#define SER_RSC_EN                 0x0001
+
+/*header data split: engine writes the headers of tcp/udp rx frames into
+ *the header buffer of the sop's desc idx and only payload into the desc
+ *buffers, see SER_DF_HDS*/
+#define SER_HDS_CTRL               0x4300
+#define SER_HDS_HDR_SZ             256
+
+/*hds ctrl flags*/
+#define SER_HDS_EN                 0x0001
+
+/*interrupts: the engine signals a q's SER_DRING_IRQ_VEC on the driver's
+ *ivshmem peer, through the eventfds the ivshmem-server handed out for
+ *its vectors; the guest sees them as msi-x vectors of ivshmem-doorbell*/
+#define SER_IRQ_CTRL               0x4400
+#define SER_IRQ_PEER               0x4404 /*ivshmem peer id (IVPosition) of the driver*/
+#define SER_IRQ_VEC_NONE           0xffff
+#define SER_IRQ_MAX_VECS           64
+
+/*per vector words, as the BAR is plain memory there's no write-1-to-clear,
+ *so each word has one writer. Mask is the driver's: 1 holds the vector's
+ *irqs back, the engine keeps its qs due and signals once it's 0 again.
+ *Cause is the engine's: a count per cause, bumped as it signals. Ack is
+ *the driver's: the cause its irq handler last took, so what came since
+ *is the difference of the counts*/
+#define SER_IRQ_VEC_MASK(v)        (0x4500 + 4 * (v))
+#define SER_IRQ_VEC_CAUSE(v)       (0x4600 + 4 * (v))
+#define SER_IRQ_VEC_ACK(v)         (0x4700 + 4 * (v))
+#define SER_ITR_USECS_MAX          0xffff
+#define SER_ITR_FRAMES_MAX         0xffff
+
+/*irq ctrl flags*/
+#define SER_IRQ_EN                 0x0001
+
+/*irq cause counts, 16 bits each in SER_IRQ_VEC_CAUSE*/
+#define SER_IRQ_CAUSE_RX           0 /*rx q handed back frames*/
+#define SER_IRQ_CAUSE_TX           16 /*tx q is done with packets*/
+#define SER_IRQ_CAUSE_CNT(c, cause) (((c) >> (cause)) & 0xffff)
+
 /*desc options*/
+#define SER_DF_LEN_MASK            0x0fff
 #define SER_DF_SOP                 (1 << 12)
 #define SER_DF_EOP                 (1 << 13)
-#define SER_DF_FRAG_CNT(n)         (((n) & 0xf) << 16)
-/* Descriptor structure */
+#define SER_DF_FRAG_CNT(n)         (((n) & 0xf) << 16) /*descs in chain, set on sop; 0 if > SER_DF_FRAG_MAX*/
+#define SER_DF_FRAG_CNT_GET(o)     (((o) >> 16) & 0xf)
+#define SER_DF_FRAG_MAX            0xf
+#define SER_DF_TSO                 (1 << 21) /*tx sop: engine segments the tcp packet, see opts2*/
+#define SER_DF_CSUM                (1 << 22) /*tx sop: engine fills in l4 csum, see opts2*/
+#define SER_DF_RSS_L3              (1 << 23) /*rx sop: rss hash over ip addrs in buf_pa_hi*/
+#define SER_DF_RSS_L4              (1 << 24) /*rx sop: rss hash over ip addrs & ports in buf_pa_hi*/
+#define SER_DF_HDS                 (1 << 25) /*rx sop: headers split off, their length in buf_pa_lo*/
+#define SER_DF_OWN                 (1U << 31) /*set by driver, cleared by engine when done*/
+
+/*desc opts2 of a tx sop desc, valid with SER_DF_TSO*/
+#define SER_DO2_MSS(n)             ((n) & 0x3fff)
+#define SER_DO2_MSS_GET(o)         ((o) & 0x3fff)
+#define SER_DO2_L4OFF(n)           (((n) & 0x3ff) << 14) /*l4 header offset in frame*/
+#define SER_DO2_L4OFF_GET(o)       (((o) >> 14) & 0x3ff)
+#define SER_DO2_L4HLEN(n)          (((n) & 0xff) << 24) /*l4 header length*/
+#define SER_DO2_L4HLEN_GET(o)      (((o) >> 24) & 0xff)
+
+/*desc opts2 of a tx sop desc, valid with SER_DF_CSUM; csum covers csum_start
+ *to end of frame, seeded with what's at csum_start + csum_off, stored there*/
+#define SER_DO2_CSUM_START(n)      SER_DO2_L4OFF (n)
+#define SER_DO2_CSUM_START_GET(o)  SER_DO2_L4OFF_GET (o)
+#define SER_DO2_CSUM_START_MAX     0x3ff
+#define SER_DO2_CSUM_OFF(n)        SER_DO2_L4HLEN (n)
+#define SER_DO2_CSUM_OFF_GET(o)    SER_DO2_L4HLEN_GET (o)
+#define SER_DO2_CSUM_OFF_MAX       0xff
+
+/*desc opts2 of an rx sop desc, checksum status written back by the engine*/
+#define SER_DO2_RX_L3CS            (1 << 0) /*ipv4 header csum checked*/
+#define SER_DO2_RX_L3CS_OK         (1 << 1) /*and found good*/
+#define SER_DO2_RX_L4CS            (1 << 2) /*tcp/udp csum checked*/
+#define SER_DO2_RX_L4CS_OK         (1 << 3) /*and found good*/
+#define SER_DO2_RX_RSC_CNT(n)      (((n) & 0xff) << 8) /*tcp segments merged by rsc, 0 if none*/
+#define SER_DO2_RX_RSC_CNT_GET(o)  (((o) >> 8) & 0xff)
+#define SER_DO2_RX_RSC_CNT_MAX     0xff
+#define SER_DO2_RX_MSS(n)          (((n) & 0x3fff) << 16) /*payload of the first merged segment*/
+#define SER_DO2_RX_MSS_GET(o)      (((o) >> 16) & 0x3fff)
+
+/* Descriptor structure
+ * A packet spans a chain of descs, sop on the first and eop on the last,
+ * a single desc packet has both. buf_pa_hi/lo is the buffer's device
+ * address, see the BAR layout above */
 typedef struct simeth_desc {
-	uint32_t            buf_pa_hi;
-	uint32_t            buf_pa_lo;
-	uint32_t            opts1; /*len: 0-11, sop: 12, eop: 13, rsvd: 14-15, frags: 16-19, rsvd: 21-31*/
-	uint32_t            opts2; /*rsvd*/
+	uint32_t            buf_pa_hi; /*rx sop written back: rss hash*/
+	uint32_t            buf_pa_lo; /*rx sop written back with hds: header length*/
+	uint32_t            opts1; /*len: 0-11, sop: 12, eop: 13, rsvd: 14-15, frags: 16-19, rsvd: 20, tso: 21, csum: 22, rss_l3: 23, rss_l4: 24, hds: 25, rsvd: 26-30, own: 31*/
+	uint32_t            opts2; /*tx tso: mss: 0-13, l4off: 14-23, l4hlen: 24-31; tx csum: start: 14-23, off: 24-31; rx: csum status: 0-3, rsc cnt: 8-15, rsc mss: 16-29*/
 } simeth_desc_t;
 
 #endif /*__SIMETH_REGS_H*/
@@ -13,7 +13,6 @@
  * Author:   ChetaN KS (chetan.kumarsanga@gmail.com)
  */
 
-#include <linux/pci-aspm.h>
 #include <linux/module.h>
 #include <linux/compiler.h>
 #include <linux/pci.h>
@@ -39,6 +38,14 @@
 #include <linux/if_macvlan.h>
 #include <linux/if_bridge.h>
 #include <linux/prefetch.h>
+#include <linux/rtnetlink.h>
+#include <linux/unaligned.h>
+#include <net/page_pool/helpers.h>
+#include <linux/bpf.h>
+#include <linux/dim.h>
+#include <linux/bpf_trace.h>
+#include <net/xdp.h>
+#include <net/xdp_sock_drv.h>
 #include <scsi/fc/fc_fcoe.h>
 #include <net/udp_tunnel.h>
 #include <net/pkt_cls.h>
@@ -70,19 +77,53 @@ module_param_named (debugm, debugm.msg_enable, int, 0660);
 MODULE_PARM_DESC (debugm, "Debug level (0=none,...,16=all)");
 
 /*Module parameter for Tx descriptor count per Tx queue*/
-static uint32_t g_n_txds = 64;
+static uint32_t g_n_txds = 256;
 module_param_named (g_n_txds, g_n_txds, int, 0660);
-MODULE_PARM_DESC (g_n_txds, "Per Queue Tx Descriptor count: 32-512, default 64; Must be aligned as per simeth.h");
+MODULE_PARM_DESC (g_n_txds, "Per Queue Tx Descriptor count: 32-512, default 256 (smaller rings cap TSO size); Must be aligned as per simeth.h");
 
 /*Module parameter for Rx descriptor count per Rx queue*/
 static uint32_t g_n_rxds = 64;
 module_param_named (g_n_rxds, g_n_rxds, int, 0660);
 MODULE_PARM_DESC (g_n_rxds, "Per Queue Rx Descriptor count: 32-512, default 64; Must be aligned as per simeth.h");
 
+/*Module parameter for number of tx/rx queue pairs*/
+static uint32_t g_n_qs = 0;
+module_param_named (g_n_qs, g_n_qs, int, 0440);
+MODULE_PARM_DESC (g_n_qs, "Number of tx/rx queue pairs: 1-16, default 0 (one per cpu, up to 16); ethtool -L changes it later");
+
+/*Module parameter for the rx copybreak*/
+static uint32_t g_rx_copybreak = SIMETH_RX_COPYBREAK;
+module_param_named (g_rx_copybreak, g_rx_copybreak, int, 0440);
+MODULE_PARM_DESC (g_rx_copybreak, "Rx frames below this many bytes go into a small napi skb, larger ones into a page_pool frag; default 256. Also ethtool rx-copybreak tunable");
+
+/*Module parameter for rx header data split*/
+static uint32_t g_rx_hds = 0;
+module_param_named (g_rx_hds, g_rx_hds, int, 0440);
+MODULE_PARM_DESC (g_rx_hds, "1 to have the engine split tcp/udp headers off rx payload, which is then packed into page aligned frags; default 0. Also ethtool -G tcp-data-split");
+
+/*Module parameters for receive segment coalescing in the engine (LRO)*/
+static uint32_t g_rsc_max_len = SIMETH_RSC_MAX_LEN;
+module_param_named (g_rsc_max_len, g_rsc_max_len, int, 0440);
+MODULE_PARM_DESC (g_rsc_max_len, "Largest frame rsc merges tcp segments into: 1-65535 bytes, default 65535; also capped by what an rx desc chain holds. ethtool -K lro switches rsc");
+
+static uint32_t g_rsc_flush_us = SIMETH_RSC_FLUSH_US;
+module_param_named (g_rsc_flush_us, g_rsc_flush_us, int, 0440);
+MODULE_PARM_DESC (g_rsc_flush_us, "Usecs rsc holds the segments of a flow before sending them up: 0-1000, default 20");
+
+/*Module parameter for the napi poll weight of every q*/
+static uint32_t g_napi_weight = SIMETH_NAPI_WEIGHT;
+module_param_named (g_napi_weight, g_napi_weight, int, 0440);
+MODULE_PARM_DESC (g_napi_weight, "Per Queue NAPI poll weight: 1-64, default 64");
+
+/*Module parameter to run napi polls in per q kthreads*/
+static uint32_t g_napi_threaded = 0;
+module_param_named (g_napi_threaded, g_napi_threaded, int, 0440);
+MODULE_PARM_DESC (g_napi_threaded, "1 to poll each q from its own napi/<dev>-<id> kthread, which can be pinned; default 0 (softirq). Also in sysfs as <dev>/threaded");
+
 /*Module parameter to enable choosing either timer or actual irq based mechanism for rx-irq*/
-static uint32_t g_rx_irqtimer = 1; /*1 for timer, 0 for irq from device via ivshmem*/
-module_param_named (g_rx_irqtimer, g_rx_irqtimer, int, 0660);
-MODULE_PARM_DESC (g_rx_irqtimer, "Choose either 1 (for timer based) or 0 (for ivshmem-device-irq based) rx interrupt");
+static uint32_t g_rx_irqtimer = 0; /*1 for timer, 0 for msi-x from ivshmem-doorbell*/
+module_param_named (g_rx_irqtimer, g_rx_irqtimer, int, 0440);
+MODULE_PARM_DESC (g_rx_irqtimer, "0 (default) for an msi-x vector per q pair, signalled by simnic through ivshmem-server, falling back to poll timers on devices without vectors (ivshmem-plain); 1 for poll timers, a usecs period per q pair that shrinks under traffic and backs off when idle");
 
 typedef enum simeth_dev_region {
 	SIMETH_BAR_0 = 0,
@@ -98,18 +139,25 @@ static const struct pci_device_id simeth_dev_ids[] = {
 	{0,} /* sentinel */
 };
 
-int (*simeth_xmit_mac_fn) (struct sk_buff *skb);
-
 #define _simeth_clean_txq(a, q) _simeth_clean_q (a, q, 0)
 #define _simeth_clean_rxq(a, q) _simeth_clean_q (a, q, 1)
+
 static void _simeth_clean_q (simeth_adapter_t *adapter, simeth_q_t *q, int is_rxq);
 static void _simeth_clean_txqs (simeth_adapter_t *adapter);
 static void _simeth_clean_rxqs (simeth_adapter_t *adapter);
+static void _simeth_clean_xdpqs (simeth_adapter_t *adapter);
 
 static void _simeth_config_tx_engine (simeth_adapter_t *adapter, int q_idx);
 static void _simeth_config_rx_engine (simeth_adapter_t *adapter, int q_idx);
+static void _simeth_stop_dring (simeth_q_t *q);
 static void _simeth_config_engines (simeth_adapter_t *adapter);
 
+static bool _simeth_tx_clean (simeth_adapter_t *adapter, simeth_txq_t *txq, int napi_budget);
+static bool _simeth_xdpq_clean (simeth_adapter_t *adapter, simeth_txq_t *xdpq);
+static bool _simeth_xsk_xmit (simeth_adapter_t *adapter, simeth_rxq_t *rxq, int budget);
+static uint32_t _simeth_rx_fill (simeth_adapter_t *adapter, simeth_rxq_t *rxq);
+static int _simeth_rx_clean (simeth_adapter_t *adapter, simeth_rxq_t *rxq, int budget);
+
 static void _simeth_stop_sw (simeth_adapter_t *adapter);
 static void simeth_down (simeth_adapter_t *adapter);
 
@@ -127,7 +175,7 @@ static int _simeth_setup_adapter (simeth_adapter_t *adapter);
 static void _simeth_release_qs (simeth_adapter_t *adapter);
 static int _simeth_alloc_qs (simeth_adapter_t *adapter);
 
-static void __used _simeth_irq_enable (simeth_adapter_t *adapter);
+static void _simeth_irq_enable (simeth_adapter_t *adapter);
 static void _simeth_irq_disable (simeth_adapter_t *adapter);
 
 static void _simeth_init_hw (simeth_adapter_t *adapter);
@@ -137,22 +185,16 @@ static int _simeth_get_valid_mac_addr (simeth_adapter_t *adapter);
 
 static void _simeth_adjust_descq_count (void);
 
-static void simeth_rxtimer_cb (unsigned long cookie);
+static enum hrtimer_restart simeth_poll_timer_cb (struct hrtimer *timer);
 static int _simeth_setup_irqh (simeth_adapter_t *adapter);
 static void _simeth_destroy_irqh (simeth_adapter_t *adapter);
 
-#if SIMETH_EN_DMA_MAPS
-#define _simeth_dma_map_skb(dev, va, sz, dir) \
-	dma_map_single ((dev), (va), (sz), (dir))
-#define _simeth_dma_unmap_skb(dev, dma, sz, dir) \
-	dma_unmap_single ((dev), (dma), (sz), (dir))
-#else
-#define _simeth_dma_map_skb(dev, va, sz, dir) virt_to_phys ((va))
-#define _simeth_dma_unmap_skb(dev, dma, sz, dir)
-#endif
-
 static inline void _simeth_clean_adapter (simeth_adapter_t *adapter)
 {
+	if (adapter->n_vecs) {
+		pci_free_irq_vectors (adapter->pcidev);
+		adapter->n_vecs = 0;
+	}
 	_simeth_release_qs (adapter);
 }
 
@@ -164,7 +206,7 @@ static void simeth_remove (struct pci_dev *pcidev)
 	simeth_info (drv, "%s\n", __func__);
 
     unregister_netdev (netdev);
-	netif_napi_del (&adapter->napi);
+	simeth_release (memunmap, adapter->bar_mem);
 	simeth_release (iounmap, adapter->ioaddr);
 	_simeth_clean_adapter (adapter);
     free_netdev (netdev);
@@ -174,24 +216,130 @@ static void simeth_remove (struct pci_dev *pcidev)
 	pci_disable_device (pcidev);
 }
 
+/* Feed net_dim the q pair's counters once a napi run is over; it works
+ * out moderation from irqs vs packets and bytes between runs */
+static void _simeth_update_dim (simeth_adapter_t *adapter, simeth_rxq_t *rxq, simeth_txq_t *txq)
+{
+	struct dim_sample sample;
+
+	if (READ_ONCE (adapter->rx_dim)) {
+		dim_update_sample (rxq->n_irqs, rxq->stats.packets, rxq->stats.bytes, &sample);
+		net_dim (&rxq->dim, &sample);
+	}
+	if (READ_ONCE (adapter->tx_dim)) {
+		dim_update_sample (rxq->n_irqs, txq->stats.packets, txq->stats.bytes, &sample);
+		net_dim (&txq->dim, &sample);
+	}
+}
+
+/* Poll timer mode: napi's off the q pair, arm its timer as we'd unmask a
+ * vector; a poll that did anything keeps the period short so the next
+ * frame is picked up quickly, idle ones back off to spare the cpu. Tx
+ * descs still with the engine count as work too, or BQL would only see
+ * their completion a backed off period later and throttle the q */
+static void _simeth_poll_rearm (simeth_rxq_t *rxq, simeth_txq_t *txq, int work_done, uint64_t tx_pkts)
+{
+	if (work_done || (txq->stats.packets != tx_pkts) || (txq->txdh != READ_ONCE (txq->txdt))) {
+		rxq->poll_usecs = SIMETH_POLL_USECS_MIN;
+	} else {
+		rxq->poll_usecs = min_t (uint32_t, rxq->poll_usecs * 2, SIMETH_POLL_USECS_MAX);
+	}
+	hrtimer_start (&rxq->poll_timer, us_to_ktime (rxq->poll_usecs), HRTIMER_MODE_REL_PINNED);
+}
+
 static int simeth_napi_rxpoll (struct napi_struct *napi, int budget)
 {
-	int ret = 0;
-	simeth_adapter_t *adapter = container_of(napi, simeth_adapter_t, napi);
+	int work_done = 0;
+	uint32_t i;
+	bool tx_done;
+	simeth_rxq_t *rxq = container_of (napi, simeth_rxq_t, napi);
+	simeth_adapter_t *adapter = netdev_priv (napi->dev);
+	simeth_txq_t *txq = adapter->txq + (rxq - adapter->rxq); /*q pair*/
+	uint64_t tx_pkts = txq->stats.packets;
 
 	simeth_dbg ("%s\n", __func__);
-	return ret;
+
+	tx_done = _simeth_tx_clean (adapter, txq, budget);
+	/*xdp tx qs are per cpu, rxq n's napi reaps n, n + n_rxqs, ...*/
+	for (i = rxq - adapter->rxq; i < adapter->n_xdpqs; i += adapter->n_rxqs) {
+		tx_done &= _simeth_xdpq_clean (adapter, SIMETH_XDPQ (adapter, i));
+	}
+	if (rxq->xsk_pool) {
+		tx_done &= _simeth_xsk_xmit (adapter, rxq, budget);
+	}
+
+	work_done = _simeth_rx_clean (adapter, rxq, budget);
+
+	if (!tx_done || (work_done == budget)) {
+		return budget; /*more to do, stay scheduled*/
+	}
+
+	/*only once napi is off the q pair may its vector fire again; if
+	 *it stays scheduled (busy polled, or irqs deferred with
+	 *napi_defer_hard_irqs), the poll that does complete it unmasks*/
+	if (napi_complete_done (napi, work_done)) {
+		if (!adapter->n_vecs) {
+			_simeth_poll_rearm (rxq, txq, work_done, tx_pkts);
+		} else {
+			_simeth_update_dim (adapter, rxq, txq);
+			simeth_vec_unmask (adapter, rxq - adapter->rxq);
+		}
+	}
+
+	return work_done;
+}
+
+static int _simeth_bpool_init (simeth_bpool_t *bp, uint32_t base, uint32_t n_slots)
+{
+	uint32_t i;
+
+	bp->slots = vzalloc (n_slots * sizeof (simeth_bslot_t));
+	if (unlikely (!bp->slots)) {
+		return -ENOMEM;
+	}
+	bp->n_slots = n_slots;
+	bp->cache = NULL;
+	init_llist_head (&bp->free);
+
+	for (i = 0; i < n_slots; i++) {
+		bp->slots[i].off = base + i * SER_BAR_BUF_SZ;
+		llist_add (&bp->slots[i].node, &bp->free);
+	}
+
+	return 0;
+}
+
+/* Take a free slot, only ever called by the q's owner (xmit/napi) */
+static inline simeth_bslot_t *_simeth_bslot_get (simeth_bpool_t *bp)
+{
+	struct llist_node *node = bp->cache;
+
+	if (!node) {
+		node = llist_del_all (&bp->free);
+		if (unlikely (!node)) {
+			return NULL;
+		}
+	}
+	bp->cache = node->next;
+
+	return llist_entry (node, simeth_bslot_t, node);
+}
+
+/* Give a slot back, from any context */
+static inline void _simeth_bslot_put (simeth_bpool_t *bp, simeth_bslot_t *slot)
+{
+	llist_add (&slot->node, &bp->free);
 }
 
 static int _simeth_setup_q (simeth_adapter_t *adapter, simeth_q_t *q, uint32_t n_desc, int is_rxq)
 {
 	int ret = 0;
 	uint32_t size = 0;
-	struct pci_dev *pcidev = adapter->pcidev;
+	uint32_t q_idx = is_rxq ? (q - adapter->rxq) : (q - adapter->txq);
 	void *mem;
 
-	/*Clean this q first*/
-	memset (q, 0, sizeof (*q));
+	/*Clean this q first, counters are kept*/
+	memset (q, 0, offsetof (simeth_q_t, stats));
 
 	/*Allocate aligned buf holder ring*/
 	size = n_desc * (is_rxq ? sizeof (simeth_rx_buf_t) : \
@@ -205,21 +353,69 @@ static int _simeth_setup_q (simeth_adapter_t *adapter, simeth_q_t *q, uint32_t n
 	q->bring_sz = size;
 	q->bring = mem;
 
-	/*Allocate aligned desc ring*/
-	size = n_desc * sizeof (simeth_desc_t);
-	size = ALIGN (size, PAGE_SIZE);
-	mem = dma_alloc_coherent (&pcidev->dev, \
-			size, &q->dring_dma_addr, GFP_KERNEL);
-	if (unlikely (!mem)) {
-		simeth_err (drv, "%cxq->dring dma_alloc_coherent failed", \
-				is_rxq?'r':'t');
-		vfree (q->bring);
-		return -ENOMEM;
+	/*desc ring has a fixed home in the BAR, engine can't see guest ram*/
+	q->dring_dma_addr = is_rxq ? SER_BAR_RX_DRING (q_idx) : SER_BAR_TX_DRING (q_idx);
+	q->dring_sz = n_desc * sizeof (simeth_desc_t);
+	q->dring = SIMETH_BAR_VA (adapter, q->dring_dma_addr);
+	memset (q->dring, 0, q->dring_sz);
+
+	/*one BAR slot per desc covers a full ring*/
+	ret = _simeth_bpool_init (&q->bpool, \
+			is_rxq ? SER_BAR_RX_POOL (q_idx) : SER_BAR_TX_POOL (q_idx), n_desc);
+	if (unlikely (ret)) {
+		simeth_err (drv, "%cxq->bpool setup failed", is_rxq?'r':'t');
+		simeth_release (vfree, q->bring);
+		return ret;
 	}
-	q->dring_sz = size;
-	q->dring = mem;
 
-	/*If we need a 32K/64K boundary check, do it later -XXX*/
+	if (is_rxq) {
+		q->hdr_dma_addr = SER_BAR_RX_HDR (q_idx);
+
+		/*frames leave the BAR through pages recycled within napi, the
+		 *engine never sees them so the pool does no dma mapping*/
+		struct page_pool_params pp = {
+			.order = 0,
+			.pool_size = n_desc,
+			.nid = NUMA_NO_NODE,
+			.dev = &adapter->pcidev->dev,
+			.napi = &q->napi,
+		};
+
+		q->page_pool = page_pool_create (&pp);
+		if (IS_ERR (q->page_pool)) {
+			ret = PTR_ERR (q->page_pool);
+			q->page_pool = NULL;
+			simeth_err (drv, "rxq->page_pool create failed: %d", ret);
+			simeth_release (vfree, q->bpool.slots);
+			simeth_release (vfree, q->bring);
+			return ret;
+		}
+
+		/*xdp frames redirected off this q go back to its page_pool, or
+		 *to the umem of an AF_XDP socket bound to it*/
+		q->xsk_pool = test_bit (q_idx, &adapter->xsk_qs) ? \
+			xsk_get_pool_from_qid (adapter->netdev, q_idx) : NULL;
+		/*AF_XDP sockets take their busy poll napi from here*/
+		ret = xdp_rxq_info_reg (&q->xdp_rxq, adapter->netdev, q_idx, q->napi.napi_id);
+		if (!ret) {
+			ret = q->xsk_pool ? \
+				xdp_rxq_info_reg_mem_model (&q->xdp_rxq, MEM_TYPE_XSK_BUFF_POOL, NULL) : \
+				xdp_rxq_info_reg_mem_model (&q->xdp_rxq, MEM_TYPE_PAGE_POOL, q->page_pool);
+			if (ret) {
+				xdp_rxq_info_unreg (&q->xdp_rxq);
+			}
+		}
+		if (!ret && q->xsk_pool) {
+			xsk_pool_set_rxq_info (q->xsk_pool, &q->xdp_rxq);
+		}
+		if (unlikely (ret)) {
+			simeth_err (drv, "rxq->xdp_rxq register failed: %d", ret);
+			simeth_release (page_pool_destroy, q->page_pool);
+			simeth_release (vfree, q->bpool.slots);
+			simeth_release (vfree, q->bring);
+			return ret;
+		}
+	}
 
 	q->n_desc = n_desc;
 
@@ -234,7 +430,7 @@ static int _simeth_setup_rxqs (simeth_adapter_t *adapter)
 	for (i = 0; i < adapter->n_rxqs; i++) {
 		ret = _simeth_setup_rxq (adapter, rxq + i, g_n_rxds);
 		if (unlikely (ret)) {
-			for (; i; i--) {
+			while (i--) {
 				_simeth_clean_rxq (adapter, rxq + i);
 			}
 			break;
@@ -252,7 +448,7 @@ static int _simeth_setup_txqs (simeth_adapter_t *adapter)
 	for (i = 0; i < adapter->n_txqs; i++) {
 		ret = _simeth_setup_txq (adapter, txq + i, g_n_txds);
 		if (unlikely (ret)) {
-			for (; i; i--) {
+			while (i--) {
 				_simeth_clean_txq (adapter, txq + i);
 			}
 			break;
@@ -262,22 +458,148 @@ static int _simeth_setup_txqs (simeth_adapter_t *adapter)
 	return ret;
 }
 
-static void _simeth_config_tx_engine (simeth_adapter_t *adapter, int q_idx)
+/* One xdp tx q per cpu, fed by XDP_TX and ndo_xdp_xmit on that cpu. If
+ * there are more cpus than SER_MAX_XDP_QS, they share qs under a lock */
+static int _simeth_setup_xdpqs (simeth_adapter_t *adapter)
 {
-	simeth_txq_t *txq = adapter->txq;
-	dma_addr_t txd_base = txq->dring_dma_addr;
+	int i, ret = 0;
+
+	adapter->n_xdpqs = min_t (uint32_t, nr_cpu_ids, SER_MAX_XDP_QS);
+	adapter->xdpqs_shared = (nr_cpu_ids > SER_MAX_XDP_QS);
+
+	for (i = 0; i < adapter->n_xdpqs; i++) {
+		ret = _simeth_setup_txq (adapter, SIMETH_XDPQ (adapter, i), g_n_txds);
+		if (unlikely (ret)) {
+			while (i--) {
+				_simeth_clean_txq (adapter, SIMETH_XDPQ (adapter, i));
+			}
+			break;
+		}
+		spin_lock_init (&SIMETH_XDPQ (adapter, i)->xdp_tx_lock);
+	}
 
-	simeth_sym_void (txd_base);
-	/*TODO - configure engine*/
+	return ret;
 }
 
-static void _simeth_config_rx_engine (simeth_adapter_t *adapter, int q_idx)
+/* Program a q's ring into its engine register block and enable it */
+static void _simeth_config_dring (simeth_q_t *q)
 {
-	simeth_rxq_t *rxq = adapter->rxq;
-	dma_addr_t rxd_base = rxq->dring_dma_addr;
+	/*reset the q first, engine restarts from desc 0 once enabled*/
+	simeth_w32 (q->eng_base + SER_DRING_CTRL, SER_DRING_RST);
+	simeth_w32 (q->eng_base + SER_DRING_PA_L, lower_32_bits (q->dring_dma_addr));
+	simeth_w32 (q->eng_base + SER_DRING_PA_H, upper_32_bits (q->dring_dma_addr));
+	simeth_w32 (q->eng_base + SER_DRING_SZ, q->n_desc);
+	simeth_w32 (q->eng_base + SER_DRING_TAIL, 0);
+	simeth_w32 (q->eng_base + SER_DRING_HEAD, 0);
+	simeth_w32 (q->eng_base + SER_DRING_CTRL, SER_DRING_EN);
+}
+
+static void _simeth_stop_dring (simeth_q_t *q)
+{
+	if (q->eng_base) {
+		simeth_w32 (q->eng_base + SER_DRING_CTRL, 0);
+		simeth_r32 (q->eng_base + SER_DRING_ST); /*flush posted write*/
+	}
+}
+
+static void _simeth_write_itr (simeth_q_t *q, uint32_t usecs, uint32_t frames)
+{
+	simeth_w32 (q->eng_base + SER_DRING_ITR_USECS, min_t (uint32_t, usecs, SER_ITR_USECS_MAX));
+	simeth_w32 (q->eng_base + SER_DRING_ITR_FRAMES, min_t (uint32_t, frames, SER_ITR_FRAMES_MAX));
+}
+
+/* net_dim settled on a new profile for a q, hand it to the engine */
+static void simeth_rx_dim_work (struct work_struct *work)
+{
+	struct dim *dim = container_of (work, struct dim, work);
+	simeth_rxq_t *rxq = container_of (dim, simeth_rxq_t, dim);
+	struct dim_cq_moder moder = net_dim_get_rx_moderation (dim->mode, dim->profile_ix);
+
+	_simeth_write_itr (rxq, moder.usec, moder.pkts);
+	dim->state = DIM_START_MEASURE;
+}
 
-	simeth_sym_void (rxd_base);
-	/*TODO - configure engine*/
+static void simeth_tx_dim_work (struct work_struct *work)
+{
+	struct dim *dim = container_of (work, struct dim, work);
+	simeth_txq_t *txq = container_of (dim, simeth_txq_t, dim);
+	struct dim_cq_moder moder = net_dim_get_tx_moderation (dim->mode, dim->profile_ix);
+
+	_simeth_write_itr (txq, moder.usec, moder.pkts);
+	dim->state = DIM_START_MEASURE;
+}
+
+/* Hand the engine the profile net_dim has a q on */
+static void _simeth_write_dim_itr (simeth_q_t *q, int is_rxq)
+{
+	struct dim_cq_moder moder = is_rxq ? \
+		net_dim_get_rx_moderation (q->dim.mode, q->dim.profile_ix) : \
+		net_dim_get_tx_moderation (q->dim.mode, q->dim.profile_ix);
+
+	_simeth_write_itr (q, moder.usec, moder.pkts);
+}
+
+/* Adaptive moderation is being turned on for a q: measure afresh from
+ * the profile it's on. Napi doesn't run dim on the q until the flag is set */
+static void _simeth_reset_dim (simeth_q_t *q, int is_rxq)
+{
+	q->dim.state = DIM_START_MEASURE;
+	q->dim.tune_state = DIM_PARKING_ON_TOP;
+	q->dim.steps_left = 0;
+	q->dim.steps_right = 0;
+	q->dim.tired = 0;
+	_simeth_write_dim_itr (q, is_rxq);
+}
+
+/* Irq moderation of a q: the ethtool -C values, or net_dim's profile.
+ * Xdp tx qs have no napi of their own to run dim, they stay put */
+static void _simeth_config_coal (simeth_adapter_t *adapter, simeth_q_t *q, int is_rxq)
+{
+	bool is_xdpq = !is_rxq && (q - adapter->txq >= SIMETH_MAX_QS);
+
+	if (is_rxq && adapter->rx_dim) {
+		_simeth_write_dim_itr (q, is_rxq);
+	} else if (!is_rxq && !is_xdpq && adapter->tx_dim) {
+		_simeth_write_dim_itr (q, is_rxq);
+	} else if (is_rxq) {
+		_simeth_write_itr (q, adapter->rx_coal_usecs, adapter->rx_coal_frames);
+	} else {
+		_simeth_write_itr (q, adapter->tx_coal_usecs, adapter->tx_coal_frames);
+	}
+}
+
+static void _simeth_config_tx_engine (simeth_adapter_t *adapter, int q_idx)
+{
+	simeth_txq_t *txq = adapter->txq + q_idx;
+
+	txq->eng_base = adapter->ioaddr + SER_TX_DRING_QBASE (q_idx);
+	/*completions go to the vector of the napi reaping the q*/
+	simeth_w32 (txq->eng_base + SER_DRING_IRQ_VEC, !adapter->n_vecs ? SER_IRQ_VEC_NONE : \
+			(q_idx < SIMETH_MAX_QS) ? q_idx : (q_idx - SER_XDP_TXQ (0)) % adapter->n_rxqs);
+	INIT_WORK (&txq->dim.work, simeth_tx_dim_work);
+	txq->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	_simeth_config_coal (adapter, txq, 0);
+	_simeth_config_dring (txq);
+
+	if (q_idx < SIMETH_MAX_QS) { /*xdp tx qs have no stack q behind them*/
+		netdev_tx_reset_queue (netdev_get_tx_queue (adapter->netdev, q_idx));
+	}
+}
+
+static void _simeth_config_rx_engine (simeth_adapter_t *adapter, int q_idx)
+{
+	simeth_rxq_t *rxq = adapter->rxq + q_idx;
+
+	rxq->eng_base = adapter->ioaddr + SER_RX_DRING_QBASE (q_idx);
+	simeth_w32 (rxq->eng_base + SER_DRING_HDR_PA, rxq->hdr_dma_addr);
+	simeth_w32 (rxq->eng_base + SER_DRING_IRQ_VEC, adapter->n_vecs ? q_idx : SER_IRQ_VEC_NONE);
+	INIT_WORK (&rxq->dim.work, simeth_rx_dim_work);
+	rxq->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	_simeth_config_coal (adapter, rxq, 1);
+	_simeth_config_dring (rxq);
+
+	/*hand the engine a full ring of pool slots to receive into*/
+	_simeth_rx_fill (adapter, rxq);
 }
 
 static void _simeth_config_engines (simeth_adapter_t *adapter)
@@ -287,332 +609,2082 @@ static void _simeth_config_engines (simeth_adapter_t *adapter)
 	for (i = 0; i < adapter->n_txqs; i++) {
 		_simeth_config_tx_engine (adapter, i);
 	}
+	for (i = 0; i < adapter->n_xdpqs; i++) {
+		_simeth_config_tx_engine (adapter, SER_XDP_TXQ (i));
+	}
 	for (i = 0; i < adapter->n_rxqs; i++) {
 		_simeth_config_rx_engine (adapter, i);
 	}
 }
 
-static void simeth_rxtimer_cb (unsigned long cookie)
+/* Poll timer of q pair n, fires once per period while napi is off the q
+ * pair; the poll re-arms it on completion, so if napi is still scheduled
+ * (out of budget) the poll that does complete re-arms it */
+static enum hrtimer_restart simeth_poll_timer_cb (struct hrtimer *timer)
+{
+	simeth_rxq_t *rxq = container_of (timer, simeth_rxq_t, poll_timer);
+
+	napi_schedule (&rxq->napi);
+
+	return HRTIMER_NORESTART;
+}
+
+/* Msi-x vector of q pair n. It stays masked from here until napi is
+ * done with the q pair, so the engine can't storm us meanwhile. While a
+ * socket busy polls the q pair napi_schedule does nothing; the poll that
+ * ends the busy loop completes napi and unmasks */
+static irqreturn_t simeth_msix_qh (int irq, void *cookie)
+{
+	simeth_rxq_t *rxq = (simeth_rxq_t *)cookie;
+	simeth_adapter_t *adapter = netdev_priv (rxq->napi.dev);
+	uint32_t vec = rxq - adapter->rxq;
+	uint32_t cause, ack;
+
+	simeth_vec_mask (adapter, vec);
+	/*the engine only ever bumps its cause counts, take them by acking*/
+	cause = simeth_r32 (adapter->ioaddr + SER_IRQ_VEC_CAUSE (vec));
+	ack = simeth_r32 (adapter->ioaddr + SER_IRQ_VEC_ACK (vec));
+	simeth_w32 (adapter->ioaddr + SER_IRQ_VEC_ACK (vec), cause);
+
+	rxq->n_irqs++;
+	if (unlikely (cause == ack)) {
+		rxq->n_irqs_spurious++; /*napi still runs, it unmasks when done*/
+	}
+	napi_schedule (&rxq->napi);
+
+	return IRQ_HANDLED;
+}
+
+static int _simeth_setup_irqh (simeth_adapter_t *adapter)
+{
+	simeth_rxq_t *rxq;
+	int i, ret = 0;
+
+	if (!adapter->n_vecs) {
+		/*no vectors, a poll timer per q pair stands in for them*/
+		simeth_info (drv, "Using poll timers for rx-irq, no msi-x vectors\n");
+		for (i = 0; i < adapter->n_rxqs; i++) {
+			rxq = adapter->rxq + i;
+			hrtimer_setup (&rxq->poll_timer, simeth_poll_timer_cb, \
+					CLOCK_MONOTONIC, HRTIMER_MODE_REL_PINNED);
+			rxq->poll_usecs = SIMETH_POLL_USECS_MIN;
+		}
+		return 0; /*started in _simeth_irq_enable, once napi is enabled*/
+	}
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		rxq = adapter->rxq + i;
+		snprintf (rxq->irq_name, sizeof (rxq->irq_name), "%s-q%d", \
+				adapter->netdev->name, i);
+		ret = request_irq (pci_irq_vector (adapter->pcidev, i), simeth_msix_qh, \
+				0, rxq->irq_name, rxq);
+		if (ret) {
+			simeth_err (drv, "Couldn't setup irqh for vector %d: %d\n", i, ret);
+			while (i--) {
+				free_irq (pci_irq_vector (adapter->pcidev, i), adapter->rxq + i);
+			}
+			return ret;
+		}
+		netif_napi_set_irq (&rxq->napi, pci_irq_vector (adapter->pcidev, i));
+	}
+
+	/*engine signals the vectors set per q on this peer from now on*/
+	simeth_w32 (adapter->ioaddr + SER_IRQ_PEER, adapter->ivshmem_peer);
+	simeth_w32 (adapter->ioaddr + SER_IRQ_CTRL, SER_IRQ_EN);
+
+	return 0;
+}
+
+static void _simeth_destroy_irqh (simeth_adapter_t *adapter)
+{
+	int i;
+
+	if (!adapter->n_vecs) {
+		return; /*poll timers go once napi is disabled, see simeth_down*/
+	}
+
+	simeth_w32 (adapter->ioaddr + SER_IRQ_CTRL, 0);
+	simeth_r32 (adapter->ioaddr + SER_IRQ_CTRL); /*flush posted write*/
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		free_irq (pci_irq_vector (adapter->pcidev, i), adapter->rxq + i);
+	}
+}
+
+/* Size TSO to the tx ring: two worst case skbs must fit in a ring, so a
+ * stopped q always has room to be woken up again */
+static void _simeth_tx_size_gso (simeth_adapter_t *adapter)
+{
+	struct net_device *netdev = adapter->netdev;
+	uint32_t gso_max = GSO_MAX_SIZE;
+	uint32_t descs_max = (g_n_txds - 1) / 2;
+
+	while (SIMETH_TX_DESCS_FOR (gso_max) > descs_max) {
+		gso_max -= SIMETH_TX_DLEN_MAX;
+	}
+	if (gso_max < GSO_MAX_SIZE) {
+		simeth_info (drv, "g_n_txds %u limits TSO size to %u\n", g_n_txds, gso_max);
+	}
+	netif_set_gso_max_size (netdev, gso_max);
+
+	adapter->tx_desc_needed = SIMETH_TX_DESCS_FOR (max_t (uint32_t, gso_max, \
+				MAX_JUMBO_FRAME_SIZE));
+}
+
+/* Napi of each q pair, added before the rx qs are set up so they register
+ * its id with xdp. Busy polling sockets (SO_BUSY_POLL, net.core.busy_read)
+ * find it through the id napi_gro_receive marks skbs with, and spin on
+ * simeth_napi_rxpoll; the q map lets netlink/epoll users find it too */
+static void _simeth_add_napis (simeth_adapter_t *adapter)
+{
+	int i;
+
+	/*with threaded napi on, each of these gets its own kthread*/
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		netif_napi_add_weight (adapter->netdev, &adapter->rxq[i].napi, \
+				simeth_napi_rxpoll, g_napi_weight);
+		netif_queue_set_napi (adapter->netdev, i, NETDEV_QUEUE_TYPE_RX, &adapter->rxq[i].napi);
+		netif_queue_set_napi (adapter->netdev, i, NETDEV_QUEUE_TYPE_TX, &adapter->rxq[i].napi);
+	}
+}
+
+static void _simeth_del_napis (simeth_adapter_t *adapter)
+{
+	int i;
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		netif_queue_set_napi (adapter->netdev, i, NETDEV_QUEUE_TYPE_RX, NULL);
+		netif_queue_set_napi (adapter->netdev, i, NETDEV_QUEUE_TYPE_TX, NULL);
+		netif_napi_del (&adapter->rxq[i].napi);
+	}
+}
+
+/* Hand the rss key and indirection table to the engine. Unless set with
+ * ethtool -X, the table spreads hash buckets evenly over the rx qs */
+static void _simeth_config_rss (simeth_adapter_t *adapter)
+{
+	int i;
+
+	if (!netif_is_rxfh_configured (adapter->netdev)) {
+		for (i = 0; i < SER_RSS_RETA_SZ; i++) {
+			adapter->rss_reta[i] = ethtool_rxfh_indir_default (i, adapter->n_rxqs);
+		}
+	}
+
+	for (i = 0; i < SER_RSS_KEY_SZ; i += 4) {
+		simeth_w32 (adapter->ioaddr + SER_RSS_KEY + i, \
+				get_unaligned_le32 (adapter->rss_key + i));
+	}
+	for (i = 0; i < SER_RSS_RETA_SZ; i += 4) {
+		simeth_w32 (adapter->ioaddr + SER_RSS_RETA + i, \
+				get_unaligned_le32 (adapter->rss_reta + i));
+	}
+	simeth_w32 (adapter->ioaddr + SER_RSS_N_QS, adapter->n_rxqs);
+	simeth_w32 (adapter->ioaddr + SER_RSS_CTRL, SER_RSS_EN);
+}
+
+/* Program rsc in the engine: on with LRO, merged frames no bigger than a
+ * desc chain the rx path takes, nor than half the ring */
+static void _simeth_config_rsc (simeth_adapter_t *adapter, netdev_features_t features)
+{
+	uint32_t n_descs = min_t (uint32_t, SIMETH_RX_CHAIN_MAX, g_n_rxds / 2);
+	uint32_t max_len = min_t (uint32_t, g_rsc_max_len, \
+			n_descs * min_t (uint32_t, adapter->rx_buflen, SER_BAR_BUF_SZ));
+
+	simeth_w32 (adapter->ioaddr + SER_RSC_MAX_LEN, max_len);
+	simeth_w32 (adapter->ioaddr + SER_RSC_FLUSH_US, g_rsc_flush_us);
+	simeth_w32 (adapter->ioaddr + SER_RSC_CTRL, (features & NETIF_F_LRO) ? SER_RSC_EN : 0);
+}
+
+/* Header split is switched in the engine per frame, the rx path takes
+ * frames of either kind, so this may change while the qs run. Xdp needs
+ * frames whole, it keeps header split off */
+static void _simeth_config_hds (simeth_adapter_t *adapter)
+{
+	simeth_w32 (adapter->ioaddr + SER_HDS_CTRL, \
+			(adapter->rx_hds && !adapter->xdp_prog) ? SER_HDS_EN : 0);
+}
+
+/* Spread the online cpus over the tx qs, so each cpu keeps xmitting on
+ * its own q instead of hashing flows onto qs other cpus are using */
+static void _simeth_set_xps (simeth_adapter_t *adapter)
+{
+	cpumask_var_t mask;
+	int q, cpu, i;
+
+	/*a map set by the user stays, until ethtool -L changes the qs*/
+	if (adapter->xps_n_txqs == adapter->n_txqs) {
+		return;
+	}
+	if (!zalloc_cpumask_var (&mask, GFP_KERNEL)) {
+		return; /*stack falls back to hashing*/
+	}
+
+	for (q = 0; q < adapter->n_txqs; q++) {
+		cpumask_clear (mask);
+		i = 0;
+		for_each_online_cpu (cpu) {
+			if ((i++ % adapter->n_txqs) == q) {
+				cpumask_set_cpu (cpu, mask);
+			}
+		}
+		netif_set_xps_queue (adapter->netdev, mask, q);
+	}
+	adapter->xps_n_txqs = adapter->n_txqs;
+
+	free_cpumask_var (mask);
+}
+
+static int simeth_ndo_open (struct net_device *netdev)
+{
+	int i, ret = 0;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	simeth_info (drv, "%s\n", __func__);
+
+	/*pm_runtime_get_sync (&pdev->dev);// What am I doing here? -TODO */
+
+	netif_carrier_off(netdev);
+
+	_simeth_tx_size_gso (adapter);
+
+	ret = netif_set_real_num_tx_queues (netdev, adapter->n_txqs);
+	if (!ret) {
+		ret = netif_set_real_num_rx_queues (netdev, adapter->n_rxqs);
+	}
+	if (ret) {
+		simeth_err (drv, "setting %u qs failed: %d\n", adapter->n_txqs, ret);
+		return ret;
+	}
+	_simeth_set_xps (adapter);
+
+	ret = _simeth_setup_txqs (adapter);
+	if (ret) {
+		simeth_err (drv, "_simeth_setup_txqs failed: %d\n", ret);
+		return ret;
+	}
+
+	ret = _simeth_setup_xdpqs (adapter);
+	if (ret) {
+		simeth_err (drv, "_simeth_setup_xdpqs failed: %d\n", ret);
+		goto do_rel_txqs;
+	}
+
+	_simeth_add_napis (adapter);
+
+	ret = _simeth_setup_rxqs (adapter);
+	if (ret) {
+		simeth_err (drv, "_simeth_setup_rxqs failed: %d\n", ret);
+		goto do_del_napis;
+	}
+
+	/*full-power up the phy -TODO*/
+
+	ret = _simeth_setup_irqh (adapter);
+	if (ret) {
+		goto do_rel_rxqs;
+	}
+
+	_simeth_config_rss (adapter);
+
+	_simeth_config_rsc (adapter, netdev->features);
+
+	_simeth_config_hds (adapter);
+
+	_simeth_config_engines (adapter);
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		napi_enable (&adapter->rxq[i].napi);
+	}
+	_simeth_irq_enable (adapter);
+
+	netif_tx_start_all_queues (netdev);
+	WRITE_ONCE (adapter->xdpqs_up, true);
+	adapter->up = true;
+
+	netif_carrier_on(netdev); /*TODO-get a hang of carrier apis!*/
+
+    return 0;
+
+do_rel_rxqs:
+	_simeth_clean_rxqs (adapter);
+do_del_napis:
+	_simeth_del_napis (adapter);
+	_simeth_clean_xdpqs (adapter);
+do_rel_txqs:
+	_simeth_clean_txqs (adapter);
+    return ret;
+}
+
+static void __used _simeth_rel_tx_buf (simeth_adapter_t *adapter, simeth_txq_t *txq, simeth_tx_buf_t *buf)
+{
+	if (buf->slot) {
+		_simeth_bslot_put (&txq->bpool, buf->slot);
+		buf->slot = NULL;
+	}
+
+	if (buf->skb) {
+		dev_kfree_skb_any (buf->skb);
+		buf->skb = 0;
+	}
+}
+
+static void __used _simeth_rel_rx_buf (simeth_adapter_t *adapter, simeth_rxq_t *rxq, simeth_rx_buf_t *buf)
+{
+	if (buf->slot) {
+		_simeth_bslot_put (&rxq->bpool, buf->slot);
+		buf->slot = NULL;
+	}
+
+	if (buf->skb) {
+		dev_kfree_skb_any (buf->skb);
+		buf->skb = 0;
+	}
+}
+
+/* Post free BAR slots on every empty rx desc and tell the engine */
+static uint32_t _simeth_rx_fill (simeth_adapter_t *adapter, simeth_rxq_t *rxq)
+{
+	uint32_t n = 0, idx = rxq->rxdt;
+	uint32_t len = min_t (uint32_t, READ_ONCE (adapter->rx_buflen), SER_BAR_BUF_SZ);
+	simeth_rx_buf_t *buf;
+	simeth_desc_t *rxd;
+	simeth_bslot_t *slot;
+
+	while (SIMETH_DESC_UNUSED (rxq)) {
+		slot = _simeth_bslot_get (&rxq->bpool);
+		if (unlikely (!slot)) {
+			break;
+		}
+		buf = rxq->rx_bring + idx;
+		buf->slot = slot;
+		rxd = rxq->rx_dring + idx;
+		rxd->buf_pa_hi = 0;
+		rxd->buf_pa_lo = slot->off;
+		rxd->opts2 = 0;
+		rxd->opts1 = len | SER_DF_OWN;
+
+		idx = SIMETH_DESC_NEXT (rxq, idx);
+		rxq->rxdt = idx;
+		n++;
+	}
+
+	if (n) {
+		/*descs must be visible before the engine sees the new tail*/
+		dma_wmb ();
+		simeth_w32 (rxq->eng_base + SER_DRING_TAIL, rxq->rxdt);
+	}
+
+	return n;
+}
+
+static void _simeth_clean_q (simeth_adapter_t *adapter, simeth_q_t *q, int is_rxq)
+{
+	int i;
+
+	if (!q->bring) return;
+
+	if (is_rxq) {
+		for (i = 0; i < q->n_desc; i++) {
+			_simeth_rel_rx_buf (adapter, q, q->rx_bring + i);
+		}
+	} else {
+		for (i = 0; i < q->n_desc; i++) {
+			_simeth_rel_tx_buf (adapter, q, q->tx_bring + i);
+		}
+	}
+
+	simeth_release (vfree, q->bring);
+	simeth_release (vfree, q->bpool.slots);
+	if (xdp_rxq_info_is_reg (&q->xdp_rxq)) {
+		xdp_rxq_info_unreg (&q->xdp_rxq);
+	}
+	simeth_release (page_pool_destroy, q->page_pool);
+	q->dring = NULL; /*BAR memory, nothing to free*/
+}
+
+static void _simeth_clean_txqs (simeth_adapter_t *adapter)
+{
+	int i;
+	simeth_txq_t *txq = adapter->txq;
+
+	for (i = 0; i < adapter->n_txqs; i++) {
+		_simeth_clean_txq (adapter, txq + i);
+	}
+}
+
+static void _simeth_clean_xdpqs (simeth_adapter_t *adapter)
+{
+	int i;
+
+	for (i = 0; i < adapter->n_xdpqs; i++) {
+		_simeth_clean_txq (adapter, SIMETH_XDPQ (adapter, i));
+	}
+}
+
+static void _simeth_clean_rxqs (simeth_adapter_t *adapter)
+{
+	int i;
+	simeth_rxq_t *rxq = adapter->rxq;
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		_simeth_clean_rxq (adapter, rxq + i);
+	}
+}
+
+static void _simeth_stop_sw (simeth_adapter_t *adapter)
+{
+	/*If tasklets/workqueues are set, cancel'em all -TODO*/
+}
+
+static void simeth_down (simeth_adapter_t *adapter)
+{
+	int i;
+	struct net_device *netdev = adapter->netdev;
+
+	/*a reopen that failed already tore everything down*/
+	if (!adapter->up) {
+		return;
+	}
+	adapter->up = false;
+
+	netif_carrier_off (netdev);
+
+	/*ndo_xdp_xmit and ndo_xsk_wakeup run under rcu, wait out any
+	 *caught in flight*/
+	WRITE_ONCE (adapter->xdpqs_up, false);
+	synchronize_net ();
+
+	_simeth_destroy_irqh (adapter);
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		_simeth_stop_dring (adapter->rxq + i);
+	}
+
+	netif_tx_disable (netdev);
+
+	for (i = 0; i < adapter->n_txqs; i++) {
+		_simeth_stop_dring (adapter->txq + i);
+	}
+	for (i = 0; i < adapter->n_xdpqs; i++) {
+		_simeth_stop_dring (SIMETH_XDPQ (adapter, i));
+	}
+	msleep (10);
+
+	for (i = 0; i < adapter->n_rxqs; i++) {
+		napi_disable (&adapter->rxq[i].napi);
+		if (!adapter->n_vecs) {
+			/*no poll left to re-arm it, nor napi for it to schedule*/
+			hrtimer_cancel (&adapter->rxq[i].poll_timer);
+		}
+		cancel_work_sync (&adapter->rxq[i].dim.work);
+		cancel_work_sync (&adapter->txq[i].dim.work);
+	}
+	_simeth_del_napis (adapter);
+
+	_simeth_irq_disable (adapter);
+
+	_simeth_stop_sw (adapter);
+
+	_simeth_reset_hw (adapter);
+
+	_simeth_clean_txqs (adapter);
+	_simeth_clean_xdpqs (adapter);
+	_simeth_clean_rxqs (adapter);
+}
+
+static int simeth_ndo_stop (struct net_device *netdev)
+{
+	int ret = 0;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	simeth_info (drv, "%s\n", __func__);
+
+	simeth_down (adapter);
+
+    return ret;
+}
+
+/* Trust the engine's tcp/udp csum check, as long as the ipv4 header (if
+ * any) checked out too. Anything else, bad sums included, is left for
+ * the stack to verify and account */
+static inline void _simeth_rx_csum (struct sk_buff *skb, uint32_t opts2)
+{
+	uint32_t l4_ok = SER_DO2_RX_L4CS | SER_DO2_RX_L4CS_OK;
+	uint32_t l3_ok = SER_DO2_RX_L3CS | SER_DO2_RX_L3CS_OK;
+
+	if (((opts2 & l4_ok) == l4_ok) && \
+			(!(opts2 & SER_DO2_RX_L3CS) || ((opts2 & l3_ok) == l3_ok))) {
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+	} else {
+		skb_checksum_none_assert (skb);
+	}
+}
+
+/* Copy a small frame out of its BAR slot into a napi skb, costs less
+ * than a pool frag plus skb build for a frame mostly made of headers */
+static inline struct sk_buff *_simeth_rx_copy_skb (simeth_adapter_t *adapter, \
+		simeth_rxq_t *rxq, simeth_bslot_t *slot, uint32_t len)
+{
+	struct sk_buff *skb;
+
+	skb = napi_alloc_skb (&rxq->napi, len);
+	if (likely (skb)) {
+		skb_put_data (skb, SIMETH_BAR_VA (adapter, slot->off), len);
+	}
+
+	return skb;
+}
+
+/* Copy a frame out of its BAR slot into a page_pool frag of truesize
+ * bytes, headroom bytes in; NULL if the pool is out of pages */
+static void *_simeth_rx_copy_frag (simeth_adapter_t *adapter, simeth_rxq_t *rxq, \
+		simeth_bslot_t *slot, uint32_t len, uint32_t headroom, uint32_t truesize)
+{
+	uint32_t offset;
+	struct page *page;
+	void *va;
+
+	page = page_pool_dev_alloc_frag (rxq->page_pool, &offset, truesize);
+	if (unlikely (!page)) {
+		return NULL;
+	}
+	va = page_address (page) + offset;
+
+	/*one copy out of the BAR, straight into the frame's final home*/
+	memcpy (va + headroom, SIMETH_BAR_VA (adapter, slot->off), len);
+
+	return va;
+}
+
+/* Build an skb around a frame in a page_pool frag; the frag goes back to
+ * the pool when the skb is freed, or right away if there's no skb */
+static struct sk_buff *_simeth_rx_frag_skb (simeth_rxq_t *rxq, void *va, \
+		uint32_t truesize, uint32_t headroom, uint32_t len)
+{
+	struct sk_buff *skb;
+
+	skb = napi_build_skb (va, truesize);
+	if (unlikely (!skb)) {
+		page_pool_put_full_page (rxq->page_pool, virt_to_head_page (va), true);
+		return NULL;
+	}
+	skb_mark_for_recycle (skb);
+	skb_reserve (skb, headroom);
+	__skb_put (skb, len);
+
+	return skb;
+}
+
+static struct sk_buff *_simeth_rx_build_skb (simeth_adapter_t *adapter, \
+		simeth_rxq_t *rxq, simeth_bslot_t *slot, uint32_t len)
+{
+	uint32_t truesize = SIMETH_RX_FRAG_SZ (SIMETH_RX_HEADROOM, len);
+	void *va;
+
+	va = _simeth_rx_copy_frag (adapter, rxq, slot, len, SIMETH_RX_HEADROOM, truesize);
+	if (unlikely (!va)) {
+		return NULL;
+	}
+
+	return _simeth_rx_frag_skb (rxq, va, truesize, SIMETH_RX_HEADROOM, len);
+}
+
+/* Hand the engine all descs up to txdt */
+static inline void _simeth_tx_doorbell (simeth_txq_t *txq)
+{
+	/*writel orders all prior desc writes before the tail update*/
+	simeth_w32 (txq->eng_base + SER_DRING_TAIL, txq->txdt);
+	txq->txdt_rung = txq->txdt;
+	txq->n_doorbells++;
+}
+
+/* Xdp tx q of this cpu, locked if cpus share it. Napi and ndo_xdp_xmit
+ * both run in softirq, so a q a cpu has to itself needs no lock */
+static inline simeth_txq_t *_simeth_xdpq_get (simeth_adapter_t *adapter)
+{
+	simeth_txq_t *xdpq = SIMETH_XDPQ (adapter, smp_processor_id () % adapter->n_xdpqs);
+
+	if (adapter->xdpqs_shared) {
+		spin_lock (&xdpq->xdp_tx_lock);
+	}
+	return xdpq;
+}
+
+static inline void _simeth_xdpq_put (simeth_adapter_t *adapter, simeth_txq_t *xdpq)
+{
+	if (adapter->xdpqs_shared) {
+		spin_unlock (&xdpq->xdp_tx_lock);
+	}
+}
+
+/* Put a frame on an xdp tx q, copied into BAR slots as one desc chain.
+ * Caller holds the q through _simeth_xdpq_get and rings the doorbell,
+ * once per poll or bulk */
+static int _simeth_xdp_tx (simeth_adapter_t *adapter, simeth_txq_t *xdpq, \
+		const void *data, uint32_t len)
+{
+	uint32_t n_descs = SIMETH_TX_DESCS_FOR (len);
+	uint32_t first, idx, off, n;
+	simeth_desc_t *txd;
+	simeth_bslot_t *slot;
+
+	if (unlikely (!len || (SIMETH_DESC_UNUSED (xdpq) < n_descs))) {
+		return -ENOSPC;
+	}
+
+	first = idx = xdpq->txdt;
+	for (off = 0; off < len; off += n) {
+		n = min_t (uint32_t, len - off, SIMETH_TX_DLEN_MAX);
+		slot = _simeth_bslot_get (&xdpq->bpool);
+		if (unlikely (!slot)) {
+			goto do_unput;
+		}
+		memcpy (SIMETH_BAR_VA (adapter, slot->off), data + off, n);
+		xdpq->tx_bring[idx].slot = slot;
+		xdpq->tx_bring[idx].n_bytes = n;
+
+		txd = xdpq->tx_dring + idx;
+		txd->buf_pa_hi = 0;
+		txd->buf_pa_lo = slot->off;
+		txd->opts2 = 0;
+		txd->opts1 = n | SER_DF_OWN | ((off + n == len) ? SER_DF_EOP : 0);
+		idx = SIMETH_DESC_NEXT (xdpq, idx);
+	}
+
+	/*engine must see the whole chain before it sees its sop*/
+	dma_wmb ();
+	xdpq->tx_dring[first].opts1 |= SER_DF_SOP | \
+		SER_DF_FRAG_CNT ((n_descs <= SER_DF_FRAG_MAX) ? n_descs : 0);
+	WRITE_ONCE (xdpq->txdt, idx);
+	xdpq->n_pkts++;
+
+	return 0;
+
+do_unput:
+	while (idx != first) {
+		idx = (idx ? idx : xdpq->n_desc) - 1;
+		_simeth_bslot_put (&xdpq->bpool, xdpq->tx_bring[idx].slot);
+		xdpq->tx_bring[idx].slot = NULL;
+	}
+	return -ENOSPC;
+}
+
+/* Run the xdp prog on a frame, copied out of its BAR slot into a
+ * page_pool frag with XDP_PACKET_HEADROOM in front of it. Returns the
+ * verdict, *skbp gets the skb for XDP_PASS; -ENOMEM if there was no
+ * frag to run it on. XDP_TX copies the frame on to this cpu's xdp tx q,
+ * so its frag is back in the pool right away, like a dropped one's */
+static int _simeth_rx_xdp (simeth_adapter_t *adapter, simeth_rxq_t *rxq, \
+		struct bpf_prog *prog, simeth_bslot_t *slot, uint32_t len, struct sk_buff **skbp)
+{
+	uint32_t truesize = SIMETH_RX_FRAG_SZ (SIMETH_RX_XDP_HEADROOM, len);
+	uint32_t act, metasize;
+	struct xdp_buff xdp;
+	simeth_txq_t *xdpq;
+	void *va;
+	int ret;
+
+	*skbp = NULL;
+	va = _simeth_rx_copy_frag (adapter, rxq, slot, len, SIMETH_RX_XDP_HEADROOM, truesize);
+	if (unlikely (!va)) {
+		return -ENOMEM;
+	}
+
+	xdp_init_buff (&xdp, truesize, &rxq->xdp_rxq);
+	xdp_prepare_buff (&xdp, va, SIMETH_RX_XDP_HEADROOM, len, true);
+
+	act = bpf_prog_run_xdp (prog, &xdp);
+	switch (act) {
+		case XDP_PASS:
+			metasize = xdp.data - xdp.data_meta;
+			*skbp = _simeth_rx_frag_skb (rxq, va, truesize, xdp.data - va, \
+					xdp.data_end - xdp.data);
+			if (*skbp && metasize) {
+				skb_metadata_set (*skbp, metasize);
+			}
+			return act;
+		case XDP_TX:
+			xdpq = _simeth_xdpq_get (adapter);
+			ret = _simeth_xdp_tx (adapter, xdpq, xdp.data, xdp.data_end - xdp.data);
+			_simeth_xdpq_put (adapter, xdpq);
+			if (likely (!ret)) {
+				break;
+			}
+			goto do_exception;
+		case XDP_REDIRECT:
+			if (likely (!xdp_do_redirect (adapter->netdev, &xdp, prog))) {
+				return act; /*frag belongs to the redirect target now*/
+			}
+			goto do_exception;
+		default:
+			bpf_warn_invalid_xdp_action (adapter->netdev, prog, act);
+			fallthrough;
+		case XDP_ABORTED:
+do_exception:
+			trace_xdp_exception (adapter->netdev, prog, act);
+			fallthrough;
+		case XDP_DROP:
+			act = XDP_DROP;
+			break;
+	}
+
+	page_pool_put_full_page (rxq->page_pool, virt_to_head_page (va), true);
+	return act;
+}
+
+/* _simeth_rx_xdp for an rxq bound to an AF_XDP umem. The frame is copied
+ * out of its BAR slot straight into a umem chunk off the fill ring, so a
+ * redirect to the socket hands it over with no further copy; a pass
+ * copies it out again into a napi skb, the chunk can't go up the stack */
+static int _simeth_rx_xsk (simeth_adapter_t *adapter, simeth_rxq_t *rxq, \
+		struct bpf_prog *prog, simeth_bslot_t *slot, uint32_t len, struct sk_buff **skbp)
+{
+	struct xsk_buff_pool *pool = rxq->xsk_pool;
+	uint32_t act, metasize;
+	struct xdp_buff *xdp;
+	simeth_txq_t *xdpq;
+	int ret;
+
+	*skbp = NULL;
+	xdp = xsk_buff_alloc (pool);
+	if (unlikely (!xdp)) {
+		/*fill ring ran dry, have the app poke us once it refilled*/
+		xsk_set_rx_need_wakeup (pool);
+		return -ENOMEM;
+	}
+	xsk_clear_rx_need_wakeup (pool);
+	if (unlikely (len > xsk_pool_get_rx_frame_size (pool))) {
+		xsk_buff_free (xdp);
+		return -EINVAL;
+	}
+
+	memcpy (xdp->data, SIMETH_BAR_VA (adapter, slot->off), len);
+	xdp->data_end = xdp->data + len;
+
+	act = bpf_prog_run_xdp (prog, xdp);
+	switch (act) {
+		case XDP_REDIRECT:
+			if (likely (!xdp_do_redirect (adapter->netdev, xdp, prog))) {
+				return act; /*chunk is the socket's now*/
+			}
+			goto do_exception;
+		case XDP_PASS:
+			metasize = xdp->data - xdp->data_meta;
+			*skbp = napi_alloc_skb (&rxq->napi, xdp->data_end - xdp->data_meta);
+			if (likely (*skbp)) {
+				skb_put_data (*skbp, xdp->data_meta, xdp->data_end - xdp->data_meta);
+				if (metasize) {
+					__skb_pull (*skbp, metasize);
+					skb_metadata_set (*skbp, metasize);
+				}
+			}
+			break;
+		case XDP_TX:
+			xdpq = _simeth_xdpq_get (adapter);
+			ret = _simeth_xdp_tx (adapter, xdpq, xdp->data, xdp->data_end - xdp->data);
+			_simeth_xdpq_put (adapter, xdpq);
+			if (likely (!ret)) {
+				break;
+			}
+			goto do_exception;
+		default:
+			bpf_warn_invalid_xdp_action (adapter->netdev, prog, act);
+			fallthrough;
+		case XDP_ABORTED:
+do_exception:
+			trace_xdp_exception (adapter->netdev, prog, act);
+			fallthrough;
+		case XDP_DROP:
+			act = XDP_DROP;
+			break;
+	}
+
+	xsk_buff_free (xdp);
+	return act;
+}
+
+/* Copy the bytes of a desc after the sop out of its BAR slot into a
+ * page_pool frag, added to the skb built from the sop */
+static int _simeth_rx_add_frag (simeth_adapter_t *adapter, simeth_rxq_t *rxq, \
+		struct sk_buff *skb, simeth_bslot_t *slot, uint32_t len)
+{
+	uint32_t truesize = SKB_DATA_ALIGN (len);
+	uint32_t offset;
+	struct page *page;
+
+	page = page_pool_dev_alloc_frag (rxq->page_pool, &offset, truesize);
+	if (unlikely (!page)) {
+		return -ENOMEM;
+	}
+	memcpy (page_address (page) + offset, SIMETH_BAR_VA (adapter, slot->off), len);
+
+	skb_add_rx_frag (skb, skb_shinfo (skb)->nr_frags, page, offset, len, truesize);
+	skb_mark_for_recycle (skb); /*head may be a copybreak one*/
+
+	return 0;
+}
+
+/* Build the skb of a header split frame: headers from the sop's header
+ * buffer into a small skb head, payload of the chain packed into whole
+ * page_pool pages hung off it as frags. Payload starts page aligned, so
+ * zerocopy readers (tcp mmap, splice) can take the pages as they are */
+static struct sk_buff *_simeth_rx_hds_skb (simeth_adapter_t *adapter, \
+		simeth_rxq_t *rxq, uint32_t dh, uint32_t n_descs, uint32_t hdr_len)
+{
+	uint32_t i, len, n, pg_len = 0;
+	struct page *page = NULL;
+	struct sk_buff *skb;
+	const uint8_t *src;
+
+	skb = napi_alloc_skb (&rxq->napi, hdr_len);
+	if (unlikely (!skb)) {
+		return NULL;
+	}
+	skb_put_data (skb, SIMETH_BAR_VA (adapter, rxq->hdr_dma_addr + dh * SER_HDS_HDR_SZ), hdr_len);
+	skb_mark_for_recycle (skb);
+
+	for (i = 0; i < n_descs; i++, dh = SIMETH_DESC_NEXT (rxq, dh)) {
+		src = SIMETH_BAR_VA (adapter, rxq->rx_bring[dh].slot->off);
+		len = rxq->rx_dring[dh].opts1 & SER_DF_LEN_MASK;
+		while (len) {
+			if (!page) {
+				if (unlikely (skb_shinfo (skb)->nr_frags == MAX_SKB_FRAGS)) {
+					goto do_free;
+				}
+				page = page_pool_dev_alloc_pages (rxq->page_pool);
+				if (unlikely (!page)) {
+					goto do_free;
+				}
+				pg_len = 0;
+			}
+			n = min_t (uint32_t, len, PAGE_SIZE - pg_len);
+			memcpy (page_address (page) + pg_len, src, n);
+			pg_len += n;
+			src += n;
+			len -= n;
+			if (pg_len == PAGE_SIZE) {
+				skb_add_rx_frag (skb, skb_shinfo (skb)->nr_frags, page, 0, pg_len, PAGE_SIZE);
+				page = NULL;
+			}
+		}
+	}
+	if (page) {
+		skb_add_rx_frag (skb, skb_shinfo (skb)->nr_frags, page, 0, pg_len, PAGE_SIZE);
+	}
+
+	return skb;
+
+do_free:
+	dev_kfree_skb_any (skb);
+	return NULL;
+}
+
+/* Descs of the frame starting at dh, up to its eop; 0 if the chain is
+ * broken: no eop before rxdt, a sop in the middle or a desc still owned
+ * by the engine */
+static uint32_t _simeth_rx_chain_len (simeth_rxq_t *rxq, uint32_t dh)
+{
+	uint32_t n = 0, opts1;
+
+	do {
+		opts1 = READ_ONCE (rxq->rx_dring[dh].opts1);
+		if ((opts1 & SER_DF_OWN) || (n && (opts1 & SER_DF_SOP))) {
+			return 0;
+		}
+		n++;
+		if (opts1 & SER_DF_EOP) {
+			return n;
+		}
+		dh = SIMETH_DESC_NEXT (rxq, dh);
+	} while (dh != rxq->rxdt);
+
+	return 0;
+}
+
+/* Frame the engine's rsc merged out of several tcp segments goes up as a
+ * gso skb, set up the way tcp_gro_complete leaves one: CHECKSUM_PARTIAL
+ * at the tcp header, seeded with the pseudo header sum, so it can be
+ * resegmented in software if it's forwarded to a device without tso.
+ * skb->data is at the ip header, the engine only merges untagged frames
+ * without ip options or ipv6 extension headers */
+static inline void _simeth_rx_rsc (struct sk_buff *skb, uint32_t opts2)
+{
+	uint32_t n_segs = SER_DO2_RX_RSC_CNT_GET (opts2);
+	uint32_t thoff, gso_type;
+	struct tcphdr *th;
+
+	if (n_segs < 2) {
+		return;
+	}
+
+	if (skb->protocol == htons (ETH_P_IP)) {
+		if (!pskb_may_pull (skb, sizeof (struct iphdr))) {
+			return;
+		}
+		thoff = ip_hdr (skb)->ihl * 4;
+		gso_type = SKB_GSO_TCPV4;
+	} else if (skb->protocol == htons (ETH_P_IPV6)) {
+		if (!pskb_may_pull (skb, sizeof (struct ipv6hdr)) || \
+				(ipv6_hdr (skb)->nexthdr != IPPROTO_TCP)) {
+			return;
+		}
+		thoff = sizeof (struct ipv6hdr);
+		gso_type = SKB_GSO_TCPV6;
+	} else {
+		return;
+	}
+	if (!pskb_may_pull (skb, thoff + sizeof (struct tcphdr))) {
+		return;
+	}
+
+	skb_reset_network_header (skb);
+	skb_set_transport_header (skb, thoff);
+	th = tcp_hdr (skb);
+	if (gso_type == SKB_GSO_TCPV4) {
+		th->check = ~csum_tcpudp_magic (ip_hdr (skb)->saddr, ip_hdr (skb)->daddr, \
+				skb->len - thoff, IPPROTO_TCP, 0);
+	} else {
+		th->check = ~csum_ipv6_magic (&ipv6_hdr (skb)->saddr, &ipv6_hdr (skb)->daddr, \
+				skb->len - thoff, IPPROTO_TCP, 0);
+	}
+	skb->csum_start = skb_transport_header (skb) - skb->head;
+	skb->csum_offset = offsetof (struct tcphdr, check);
+	skb->ip_summed = CHECKSUM_PARTIAL;
+
+	skb_shinfo (skb)->gso_size = SER_DO2_RX_MSS_GET (opts2);
+	skb_shinfo (skb)->gso_type = gso_type | (th->cwr ? SKB_GSO_TCP_ECN : 0);
+	skb_shinfo (skb)->gso_segs = n_segs;
+}
+
+/* Pass up to budget frames the engine handed back, starting at rxdh, to
+ * the stack. The sop's bytes are copied out of its BAR slot into a
+ * page_pool frag (or a small skb under copybreak), those of the rest of
+ * the chain into frags of that skb. Slots go back on the ring in batches
+ * of SIMETH_RX_REFILL_BATCH */
+static int _simeth_rx_clean (simeth_adapter_t *adapter, simeth_rxq_t *rxq, int budget)
+{
+	struct net_device *netdev = adapter->netdev;
+	uint32_t dh = rxq->rxdh;
+	uint32_t opts1, opts2, len, hash, n_bytes = 0, n_errs = 0, n_drops = 0, n_refill = 0;
+	uint32_t i, idx, n_descs, hdr_len;
+	uint32_t n_xdp_tx = 0, n_xdp_redirect = 0, n_xdp_drop = 0;
+	uint32_t copybreak = READ_ONCE (adapter->rx_copybreak);
+	struct bpf_prog *xdp_prog = READ_ONCE (adapter->xdp_prog);
+	bool rxhash = !!(netdev->features & NETIF_F_RXHASH);
+	bool rxcsum = !!(netdev->features & NETIF_F_RXCSUM);
+	int n_pkts = 0, act;
+	simeth_desc_t *rxd;
+	simeth_rx_buf_t *buf;
+	simeth_txq_t *xdpq;
+	struct sk_buff *skb;
+
+	while ((n_pkts < budget) && (dh != rxq->rxdt)) {
+		rxd = rxq->rx_dring + dh;
+		opts1 = READ_ONCE (rxd->opts1);
+		if (opts1 & SER_DF_OWN) {
+			break; /*engine hasn't filled it yet*/
+		}
+		/*frame bytes only after the engine handed the desc back*/
+		dma_rmb ();
+
+		buf = rxq->rx_bring + dh;
+		len = opts1 & SER_DF_LEN_MASK;
+		hash = rxd->buf_pa_hi; /*engine's rss hash, see SER_DF_RSS_L3/L4*/
+		opts2 = rxd->opts2; /*engine's csum status, rsc count and mss*/
+		hdr_len = (opts1 & SER_DF_HDS) ? rxd->buf_pa_lo : 0; /*in the header buffer*/
+		n_descs = _simeth_rx_chain_len (rxq, dh);
+		skb = NULL;
+		if (unlikely (!(opts1 & SER_DF_SOP) || !n_descs || (n_descs > SIMETH_RX_CHAIN_MAX) || \
+					((hdr_len ? hdr_len : len) < ETH_HLEN) || (hdr_len > SER_HDS_HDR_SZ))) {
+			simeth_err (rx_err, "rxq %ld desc %u: bad opts1 0x%08x, %u descs\n", \
+					(long)(rxq - adapter->rxq), dh, opts1, n_descs);
+			n_errs++;
+			n_descs = max_t (uint32_t, n_descs, 1); /*skip the whole chain*/
+		} else if (xdp_prog) {
+			/*the prog must see every frame whole, the mtu keeps them
+			 *in one buffer; anything else is dropped, not let past it*/
+			if ((n_descs != 1) || hdr_len) {
+				act = -EINVAL;
+			} else if (rxq->xsk_pool) {
+				act = _simeth_rx_xsk (adapter, rxq, xdp_prog, buf->slot, len, &skb);
+			} else {
+				act = _simeth_rx_xdp (adapter, rxq, xdp_prog, buf->slot, len, &skb);
+			}
+			switch (act) {
+				case XDP_PASS:
+					if (unlikely (!skb)) {
+						n_drops++;
+					}
+					break;
+				case XDP_TX:
+					n_xdp_tx++;
+					n_bytes += len;
+					break;
+				case XDP_REDIRECT:
+					n_xdp_redirect++;
+					n_bytes += len;
+					break;
+				case XDP_DROP:
+					n_xdp_drop++;
+					n_bytes += len;
+					break;
+				default:
+					n_drops++;
+					break;
+			}
+		} else if (hdr_len) {
+			skb = _simeth_rx_hds_skb (adapter, rxq, dh, n_descs, hdr_len);
+			if (unlikely (!skb)) {
+				n_drops++;
+			}
+		} else {
+			prefetch (SIMETH_BAR_VA (adapter, buf->slot->off));
+			skb = (len < copybreak) ? \
+				_simeth_rx_copy_skb (adapter, rxq, buf->slot, len) : \
+				_simeth_rx_build_skb (adapter, rxq, buf->slot, len);
+			for (i = 1, idx = SIMETH_DESC_NEXT (rxq, dh); skb && (i < n_descs); \
+					i++, idx = SIMETH_DESC_NEXT (rxq, idx)) {
+				if (unlikely (_simeth_rx_add_frag (adapter, rxq, skb, rxq->rx_bring[idx].slot, \
+								rxq->rx_dring[idx].opts1 & SER_DF_LEN_MASK))) {
+					dev_kfree_skb_any (skb);
+					skb = NULL;
+				}
+			}
+			if (unlikely (!skb)) {
+				n_drops++;
+			}
+		}
+
+		/*bytes are out of the slots, they can take the next frames*/
+		for (i = 0; i < n_descs; i++) {
+			buf = rxq->rx_bring + dh;
+			_simeth_bslot_put (&rxq->bpool, buf->slot);
+			buf->slot = NULL;
+			rxq->rx_dring[dh].opts1 = 0;
+			dh = SIMETH_DESC_NEXT (rxq, dh);
+
+			if (++n_refill == SIMETH_RX_REFILL_BATCH) {
+				rxq->rxdh = dh;
+				_simeth_rx_fill (adapter, rxq);
+				n_refill = 0;
+			}
+		}
+
+		n_pkts++;
+		if (unlikely (!skb)) {
+			continue;
+		}
+
+		/*rps/rfs take the engine's hash instead of computing one*/
+		if (rxhash && (opts1 & (SER_DF_RSS_L3 | SER_DF_RSS_L4))) {
+			skb_set_hash (skb, hash, (opts1 & SER_DF_RSS_L4) ? \
+					PKT_HASH_TYPE_L4 : PKT_HASH_TYPE_L3);
+		}
+		if (rxcsum) {
+			_simeth_rx_csum (skb, opts2);
+		}
+		skb->protocol = eth_type_trans (skb, netdev);
+		_simeth_rx_rsc (skb, opts2);
+		skb_record_rx_queue (skb, rxq - adapter->rxq);
+		n_bytes += skb->len;
+		napi_gro_receive (&rxq->napi, skb);
+	}
+	rxq->rxdh = dh;
+
+	if (n_refill) {
+		_simeth_rx_fill (adapter, rxq);
+	}
+
+	if (n_xdp_tx) {
+		/*napi doesn't move cpus mid poll, so it's the q XDP_TX used*/
+		xdpq = _simeth_xdpq_get (adapter);
+		_simeth_tx_doorbell (xdpq);
+		_simeth_xdpq_put (adapter, xdpq);
+	}
+	if (n_xdp_redirect) {
+		xdp_do_flush ();
+	}
+	if (xdp_prog) {
+		rxq->n_xdp_tx += n_xdp_tx;
+		rxq->n_xdp_redirect += n_xdp_redirect;
+		rxq->n_xdp_drop += n_xdp_drop;
+	}
+
+	if (n_pkts) {
+		u64_stats_update_begin (&rxq->stats.syncp);
+		rxq->stats.packets += n_pkts - n_errs - n_drops;
+		rxq->stats.bytes += n_bytes;
+		rxq->stats.errors += n_errs;
+		rxq->stats.dropped += n_drops;
+		u64_stats_update_end (&rxq->stats.syncp);
+	}
+
+	return n_pkts;
+}
+
+/* Reap descs the engine is done with, starting at txdh. Runs from napi
+ * poll; returns false if SIMETH_TX_CLEAN_BUDGET ran out before the ring
+ * caught up with txdt, so the poll stays scheduled */
+static bool _simeth_tx_clean (simeth_adapter_t *adapter, simeth_txq_t *txq, int napi_budget)
+{
+	uint32_t dh = txq->txdh;
+	uint32_t dt = READ_ONCE (txq->txdt);
+	uint32_t n_pkts = 0, n_bytes = 0;
+	struct netdev_queue *nq = netdev_get_tx_queue (adapter->netdev, txq - adapter->txq);
+	simeth_desc_t *txd;
+	simeth_tx_buf_t *buf;
+
+	while ((dh != dt) && (n_pkts < SIMETH_TX_CLEAN_BUDGET)) {
+		txd = txq->tx_dring + dh;
+		if (READ_ONCE (txd->opts1) & SER_DF_OWN) {
+			break; /*engine's still on it*/
+		}
+		dma_rmb ();
+
+		buf = txq->tx_bring + dh;
+		if (buf->slot) {
+			_simeth_bslot_put (&txq->bpool, buf->slot);
+			buf->slot = NULL;
+		}
+		if (buf->skb) {
+			n_pkts++;
+			n_bytes += buf->skb->len;
+			/*napi_consume_skb batches the frees into the napi skb cache*/
+			napi_consume_skb (buf->skb, napi_budget);
+			buf->skb = NULL;
+		}
+
+		dh = SIMETH_DESC_NEXT (txq, dh);
+	}
+	txq->txdh = dh;
+
+	if (!n_pkts) {
+		return (dh == dt);
+	}
+
+	netdev_tx_completed_queue (nq, n_pkts, n_bytes);
+
+	u64_stats_update_begin (&txq->stats.syncp);
+	txq->stats.packets += n_pkts;
+	txq->stats.bytes += n_bytes;
+	u64_stats_update_end (&txq->stats.syncp);
+
+	/*pairs with the barrier in xmit after stopping the q*/
+	smp_mb ();
+	if (unlikely (netif_tx_queue_stopped (nq) && netif_carrier_ok (adapter->netdev) && \
+				(SIMETH_DESC_UNUSED (txq) >= SIMETH_TX_WAKE_THRESH (adapter)))) {
+		netif_tx_wake_queue (nq);
+	}
+
+	return (dh == dt);
+}
+
+/* Reap an xdp tx q. Its frames were copied into BAR slots, so only the
+ * slots go back; there's no BQL and no stack q to wake */
+static bool _simeth_xdpq_clean (simeth_adapter_t *adapter, simeth_txq_t *xdpq)
+{
+	uint32_t dh = xdpq->txdh;
+	uint32_t dt = READ_ONCE (xdpq->txdt); /*moved by whichever cpu feeds the q*/
+	uint32_t n_pkts = 0, n_bytes = 0, opts1;
+	simeth_tx_buf_t *buf;
+
+	while ((dh != dt) && (n_pkts < SIMETH_TX_CLEAN_BUDGET)) {
+		opts1 = READ_ONCE (xdpq->tx_dring[dh].opts1);
+		if (opts1 & SER_DF_OWN) {
+			break;
+		}
+		dma_rmb ();
+
+		buf = xdpq->tx_bring + dh;
+		_simeth_bslot_put (&xdpq->bpool, buf->slot);
+		buf->slot = NULL;
+		n_bytes += buf->n_bytes;
+		n_pkts += !!(opts1 & SER_DF_EOP);
+
+		dh = SIMETH_DESC_NEXT (xdpq, dh);
+	}
+	xdpq->txdh = dh;
+
+	if (n_pkts) {
+		u64_stats_update_begin (&xdpq->stats.syncp);
+		xdpq->stats.packets += n_pkts;
+		xdpq->stats.bytes += n_bytes;
+		u64_stats_update_end (&xdpq->stats.syncp);
+	}
+
+	return (dh == dt);
+}
+
+/* Send what an AF_XDP socket queued on the umem of an rxq, out of this
+ * cpu's xdp tx q. Frames are copied into BAR slots on the way, so their
+ * chunks go back on the completion ring in the same go; returns true if
+ * the socket's tx ring is drained */
+static bool _simeth_xsk_xmit (simeth_adapter_t *adapter, simeth_rxq_t *rxq, int budget)
+{
+	struct xsk_buff_pool *pool = rxq->xsk_pool;
+	uint32_t n_max = SIMETH_TX_DESCS_FOR (xsk_pool_get_chunk_size (pool));
+	simeth_txq_t *xdpq;
+	struct xdp_desc desc;
+	bool drained = false;
+	int n = 0;
+
+	xdpq = _simeth_xdpq_get (adapter);
+	/*room for a full chunk first, a peeked desc can't be put back*/
+	while ((n < budget) && (SIMETH_DESC_UNUSED (xdpq) >= n_max)) {
+		if (!xsk_tx_peek_desc (pool, &desc)) {
+			drained = true;
+			break;
+		}
+		if (unlikely (_simeth_xdp_tx (adapter, xdpq, \
+						xsk_buff_raw_get_data (pool, desc.addr), desc.len))) {
+			xdpq->n_drops++;
+		}
+		n++;
+	}
+	if (n) {
+		_simeth_tx_doorbell (xdpq);
+		xsk_tx_release (pool);
+		xsk_tx_completed (pool, n);
+	}
+	_simeth_xdpq_put (adapter, xdpq);
+
+	/*only an empty tx ring needs a kick to get going again; while
+	 *there's more, out of budget or of room on the xdp tx q (which may
+	 *complete on another q pair's vector), this napi stays scheduled*/
+	if (xsk_uses_need_wakeup (pool)) {
+		if (drained) {
+			xsk_set_tx_need_wakeup (pool);
+		} else {
+			xsk_clear_tx_need_wakeup (pool);
+		}
+	}
+
+	return drained;
+}
+
+/* Copy skb bytes off..off+len into a free BAR slot and point desc idx at
+ * it; sop/eop are left for the caller, once the whole chain is down */
+static int _simeth_tx_put (simeth_adapter_t *adapter, simeth_txq_t *txq, \
+		uint32_t idx, struct sk_buff *skb, uint32_t off, uint32_t len)
+{
+	simeth_tx_buf_t *buf = txq->tx_bring + idx;
+	simeth_desc_t *txd = txq->tx_dring + idx;
+	simeth_bslot_t *slot;
+
+	slot = _simeth_bslot_get (&txq->bpool);
+	if (unlikely (!slot)) {
+		return -ENOSPC;
+	}
+
+	/*the one copy into engine reachable memory, head & frags alike*/
+	if (unlikely (skb_copy_bits (skb, off, SIMETH_BAR_VA (adapter, slot->off), len))) {
+		_simeth_bslot_put (&txq->bpool, slot);
+		return -EFAULT;
+	}
+
+	buf->slot = slot;
+	buf->n_bytes = len;
+
+	txd->buf_pa_hi = 0;
+	txd->buf_pa_lo = slot->off;
+	txd->opts2 = 0;
+	txd->opts1 = len | SER_DF_OWN;
+
+	return 0;
+}
+
+static netdev_tx_t simeth_ndo_start_xmit (struct sk_buff *skb, struct net_device *netdev)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	uint16_t q_idx = skb_get_queue_mapping (skb);
+	simeth_txq_t *txq = adapter->txq + q_idx;
+	struct netdev_queue *nq = netdev_get_tx_queue (netdev, q_idx);
+	uint32_t n_descs, first, last, idx, off, len;
+	uint32_t opts1 = 0, opts2 = 0, csum_start;
+
+	simeth_dbg ("%s\n", __func__);
+
+	if (skb_is_gso (skb)) {
+		/* engine cuts the super-packet into mss sized frames, it
+		 * gets mss and where the tcp header is from the sop desc */
+		opts1 = SER_DF_TSO;
+		opts2 = SER_DO2_MSS (skb_shinfo (skb)->gso_size) | \
+			SER_DO2_L4OFF (skb_transport_offset (skb)) | \
+			SER_DO2_L4HLEN (tcp_hdrlen (skb));
+	} else if (skb->ip_summed == CHECKSUM_PARTIAL) {
+		/*engine sums csum_start..end and stores it at csum_offset*/
+		csum_start = skb_checksum_start_offset (skb);
+		if (likely ((csum_start <= SER_DO2_CSUM_START_MAX) && \
+					(skb->csum_offset <= SER_DO2_CSUM_OFF_MAX))) {
+			opts1 = SER_DF_CSUM;
+			opts2 = SER_DO2_CSUM_START (csum_start) | \
+				SER_DO2_CSUM_OFF (skb->csum_offset);
+		} else if (skb_checksum_help (skb)) { /*deep encap, do it here*/
+			goto do_drop;
+		}
+	}
+
+	n_descs = SIMETH_TX_DESCS_FOR (skb->len);
+	if (unlikely (SIMETH_DESC_UNUSED (txq) < n_descs)) {
+		/*we stop the q before it's full, so this shouldn't happen*/
+		simeth_err (tx_err, "tx ring %u full while q awake\n", q_idx);
+		netif_tx_stop_queue (nq);
+		return NETDEV_TX_BUSY;
+	}
+
+	first = idx = txq->txdt;
+
+	/*skb bytes are packed into slots as one desc chain, no linearizing*/
+	for (off = 0; off < skb->len; off += len) {
+		len = min_t (uint32_t, skb->len - off, SIMETH_TX_DLEN_MAX);
+		if (unlikely (_simeth_tx_put (adapter, txq, idx, skb, off, len))) {
+			simeth_err (tx_err, "no BAR slot for skb bytes at %u\n", off);
+			goto do_unput;
+		}
+		idx = SIMETH_DESC_NEXT (txq, idx);
+	}
+
+	if (unlikely (idx == first)) { /*nothing at all to send*/
+		goto do_drop;
+	}
+
+	last = (idx ? idx : txq->n_desc) - 1;
+	txq->tx_bring[last].skb = skb;
+	txq->tx_bring[last].ts = jiffies;
+	txq->tx_dring[last].opts1 |= SER_DF_EOP;
+	/*engine must see the whole chain before it sees its sop*/
+	dma_wmb ();
+	txq->tx_dring[first].opts2 = opts2;
+	txq->tx_dring[first].opts1 |= opts1 | SER_DF_SOP | \
+		SER_DF_FRAG_CNT ((n_descs <= SER_DF_FRAG_MAX) ? n_descs : 0);
+
+	/*txdt is read locklessly by tx clean, publish it once*/
+	WRITE_ONCE (txq->txdt, idx);
+	txq->n_pkts++;
+
+	skb_tx_timestamp (skb);
+
+	if (unlikely (SIMETH_DESC_UNUSED (txq) < SIMETH_TX_DESC_NEEDED (adapter))) {
+		netif_tx_stop_queue (nq);
+		/*a reclaim may have run before the stop became visible*/
+		smp_mb ();
+		if (SIMETH_DESC_UNUSED (txq) >= SIMETH_TX_WAKE_THRESH (adapter)) {
+			netif_tx_start_queue (nq);
+		}
+	}
+
+	/* One doorbell per batch: stack tells us more skbs follow via
+	 * xmit_more, but a q stopped by us or by BQL won't get them,
+	 * so __netdev_tx_sent_queue asks us to flush then too */
+	if (__netdev_tx_sent_queue (nq, skb->len, netdev_xmit_more ())) {
+		_simeth_tx_doorbell (txq);
+	}
+
+	return NETDEV_TX_OK;
+
+do_unput:
+	for (; first != idx; first = SIMETH_DESC_NEXT (txq, first)) {
+		_simeth_rel_tx_buf (adapter, txq, txq->tx_bring + first);
+		txq->tx_dring[first].opts1 = 0;
+	}
+do_drop:
+	txq->n_drops++; /*serialized by the q's xmit lock*/
+	dev_kfree_skb_any (skb);
+	/*last of a batch may be the dropped one, flush what's pending*/
+	if (!netdev_xmit_more ()) {
+		_simeth_tx_doorbell (txq);
+	}
+	return NETDEV_TX_OK;
+}
+
+static void simeth_ndo_get_stats64 (struct net_device *netdev, struct rtnl_link_stats64 *showstats)
+{
+	uint32_t start;
+	uint64_t packets, bytes, errors, dropped, tx_drops = 0;
+	uint64_t rx_errors = 0, rx_drops = 0;
+	int q;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	simeth_stats_t *stats;
+
+	/*This log should be seen in dmesg with level 8 on printk in proc -TODO*/
+	simeth_dbg ("%s\n", __func__);
+
+	/*qs out of use after ethtool -L still hold counts from before*/
+	for (q = 0; q < SIMETH_MAX_QS; q++) {
+		stats = &adapter->rxq[q].stats;
+		do {
+			start = u64_stats_fetch_begin (&stats->syncp);
+			packets = stats->packets;
+			bytes = stats->bytes;
+			errors = stats->errors;
+			dropped = stats->dropped;
+		} while (u64_stats_fetch_retry (&stats->syncp, start));
+		showstats->rx_packets += packets;
+		showstats->rx_bytes += bytes;
+		rx_errors += errors;
+		rx_drops += dropped;
+
+		stats = &adapter->txq[q].stats;
+		do {
+			start = u64_stats_fetch_begin (&stats->syncp);
+			packets = stats->packets;
+			bytes = stats->bytes;
+		} while (u64_stats_fetch_retry (&stats->syncp, start));
+		showstats->tx_packets += packets;
+		showstats->tx_bytes += bytes;
+
+		tx_drops += READ_ONCE (adapter->txq[q].n_drops);
+	}
+
+	showstats->rx_dropped   = netdev->stats.rx_dropped + rx_drops;
+	showstats->tx_dropped   = netdev->stats.tx_dropped + tx_drops;
+	showstats->rx_length_errors = netdev->stats.rx_length_errors;
+	showstats->rx_errors    = netdev->stats.rx_errors + rx_errors;
+	showstats->rx_crc_errors    = netdev->stats.rx_crc_errors;
+	showstats->rx_fifo_errors   = netdev->stats.rx_fifo_errors;
+	showstats->rx_missed_errors = netdev->stats.rx_missed_errors;
+}
+
+/* Descs already posted keep their buffer length and a frame bigger than
+ * them just spans more of them, so there's nothing to reset: only descs
+ * posted from now on, and the rsc limit, follow the new mtu */
+static int simeth_ndo_change_mtu (struct net_device *netdev, int new_mtu)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	if (adapter->xdp_prog && (SIMETH_RX_BUFLEN (new_mtu) != MAX_ETH_VLAN_SZ)) {
+		simeth_err (drv, "mtu %d too large with an xdp prog attached\n", new_mtu);
+		return -EINVAL;
+	}
+
+	simeth_info (drv, "mtu %u -> %d\n", netdev->mtu, new_mtu);
+
+	WRITE_ONCE (netdev->mtu, new_mtu);
+	WRITE_ONCE (adapter->rx_buflen, SIMETH_RX_BUFLEN (new_mtu));
+	if (netif_running (netdev)) {
+		_simeth_config_rsc (adapter, netdev->features);
+	}
+
+	return 0;
+}
+
+static netdev_features_t simeth_ndo_fix_features (struct net_device *netdev, \
+		netdev_features_t features)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	/*xdp has to see the frames as they came in, unmerged*/
+	if (adapter->xdp_prog) {
+		features &= ~NETIF_F_LRO;
+	}
+
+	return features;
+}
+
+/* Attach, swap or detach the xdp prog. Xdp tx qs are up as long as the
+ * device is, so this happens under napi's feet, which reads the prog
+ * once a poll */
+static int _simeth_xdp_setup (simeth_adapter_t *adapter, struct bpf_prog *prog, \
+		struct netlink_ext_ack *extack)
+{
+	struct net_device *netdev = adapter->netdev;
+	struct bpf_prog *old;
+
+	if (prog && (SIMETH_RX_BUFLEN (netdev->mtu) != MAX_ETH_VLAN_SZ)) {
+		NL_SET_ERR_MSG_MOD (extack, "MTU too large for XDP, frames must fit one rx buffer");
+		return -EINVAL;
+	}
+
+	old = xchg (&adapter->xdp_prog, prog);
+	if (old) {
+		bpf_prog_put (old);
+	}
+
+	/*header split and LRO go off with a prog, and may come back without one*/
+	if (netif_running (netdev)) {
+		_simeth_config_hds (adapter);
+	}
+	netdev_update_features (netdev);
+
+	return 0;
+}
+
+/* Bind an AF_XDP umem to q pair qid, or unbind it if pool is NULL. The
+ * engine only reaches the BAR, so rx frames are still copied once, from
+ * their BAR slot into a umem chunk, and tx ones the other way; what the
+ * socket saves is the skb and the copy of the generic path. The rxq's
+ * mem model changes with it, so the device is bounced around that */
+static int _simeth_xsk_setup (simeth_adapter_t *adapter, struct xsk_buff_pool *pool, uint16_t qid)
+{
+	struct net_device *netdev = adapter->netdev;
+	bool running = netif_running (netdev);
+	bool bind = !!pool;
+	int ret = 0;
+
+	if (qid >= adapter->n_rxqs) {
+		return -EINVAL;
+	}
+
+	if (bind) {
+		/*nothing is dma'd to the umem, but the pool wants it mapped*/
+		ret = xsk_pool_dma_map (pool, &adapter->pcidev->dev, 0);
+		if (ret) {
+			return ret;
+		}
+	} else {
+		pool = xsk_get_pool_from_qid (netdev, qid);
+		if (!pool || !test_bit (qid, &adapter->xsk_qs)) {
+			return -EINVAL;
+		}
+	}
+
+	if (running) {
+		simeth_down (adapter);
+	}
+	assign_bit (qid, &adapter->xsk_qs, bind);
+	if (running) {
+		ret = simeth_ndo_open (netdev);
+	}
+
+	/*the stack drops the pool whatever an unbind returns, so only a
+	 *bind is undone; come back up without it*/
+	if (ret && bind) {
+		simeth_err (drv, "reopen with xsk on q %u failed: %d\n", qid, ret);
+		clear_bit (qid, &adapter->xsk_qs);
+		if (simeth_ndo_open (netdev)) {
+			simeth_err (drv, "reopen without xsk failed too, device stays down\n");
+		}
+	}
+	if (!bind || ret) {
+		xsk_pool_dma_unmap (pool, 0);
+	}
+
+	return ret;
+}
+
+static int simeth_ndo_bpf (struct net_device *netdev, struct netdev_bpf *bpf)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	switch (bpf->command) {
+		case XDP_SETUP_PROG:
+			return _simeth_xdp_setup (adapter, bpf->prog, bpf->extack);
+		case XDP_SETUP_XSK_POOL:
+			return _simeth_xsk_setup (adapter, bpf->xsk.pool, bpf->xsk.queue_id);
+		default:
+			return -EINVAL;
+	}
+}
+
+/* Redirect target side of xdp: a bulk of frames from another device's
+ * napi goes on this cpu's xdp tx q, one doorbell for all of them. The
+ * frames are copied into BAR slots, so they go back to their owner
+ * right away. Returns how many were taken, the caller frees the rest */
+static int simeth_ndo_xdp_xmit (struct net_device *netdev, int n, \
+		struct xdp_frame **frames, uint32_t flags)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	simeth_txq_t *xdpq;
+	int i;
+
+	if (unlikely (flags & ~XDP_XMIT_FLAGS_MASK)) {
+		return -EINVAL;
+	}
+	if (unlikely (!READ_ONCE (adapter->xdpqs_up))) {
+		return -ENETDOWN;
+	}
+
+	xdpq = _simeth_xdpq_get (adapter);
+	for (i = 0; i < n; i++) {
+		if (unlikely (xdp_frame_has_frags (frames[i]) || \
+					_simeth_xdp_tx (adapter, xdpq, frames[i]->data, frames[i]->len))) {
+			break;
+		}
+		xdp_return_frame (frames[i]);
+	}
+	xdpq->n_drops += n - i;
+	/*a flush rings for frames of earlier calls too, even if it adds none*/
+	if ((flags & XDP_XMIT_FLUSH) && (xdpq->txdt != xdpq->txdt_rung)) {
+		_simeth_tx_doorbell (xdpq);
+	}
+	_simeth_xdpq_put (adapter, xdpq);
+
+	return i;
+}
+
+/* An AF_XDP socket has tx frames queued or refilled its fill ring: run
+ * the napi of its q pair, which does both */
+static int simeth_ndo_xsk_wakeup (struct net_device *netdev, uint32_t qid, uint32_t flags)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	simeth_rxq_t *rxq;
+
+	if (!READ_ONCE (adapter->xdpqs_up)) {
+		return -ENETDOWN;
+	}
+	if ((qid >= adapter->n_rxqs) || !adapter->rxq[qid].xsk_pool) {
+		return -EINVAL;
+	}
+
+	rxq = adapter->rxq + qid;
+	if (!napi_if_scheduled_mark_missed (&rxq->napi)) {
+		local_bh_disable ();
+		napi_schedule (&rxq->napi);
+		local_bh_enable ();
+	}
+
+	return 0;
+}
+
+static int simeth_ndo_set_features (struct net_device *netdev, netdev_features_t features)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	/*rsc switches in the engine on the fly, it sends up what it holds*/
+	if (((netdev->features ^ features) & NETIF_F_LRO) && netif_running (netdev)) {
+		_simeth_config_rsc (adapter, features);
+	}
+
+	return 0;
+}
+
+static const struct net_device_ops simeth_netdev_ops = {
+	.ndo_open = simeth_ndo_open,
+	.ndo_stop = simeth_ndo_stop,
+	.ndo_get_stats64 = simeth_ndo_get_stats64,
+	.ndo_start_xmit = simeth_ndo_start_xmit,
+	.ndo_fix_features = simeth_ndo_fix_features,
+	.ndo_set_features = simeth_ndo_set_features,
+	.ndo_bpf = simeth_ndo_bpf,
+	.ndo_xdp_xmit = simeth_ndo_xdp_xmit,
+	.ndo_xsk_wakeup = simeth_ndo_xsk_wakeup,
+	/*.ndo_tx_timeout = simeth_ndo_tx_timeout,*/
+	/*.ndo_validate_addr = simeth_ndo_validate_addr,*/
+	.ndo_change_mtu = simeth_ndo_change_mtu,
+	/*.ndo_set_mac_address = simeth_ndo_set_mac_address,*/
+	/*.ndo_do_ioctl = simeth_ndo_do_ioctl,*/
+	/*.ndo_set_rx_mode = simeth_ndo_set_rx_mode,*/
+#ifdef CONFIG_NET_POLL_CONTROLLER
+	/*.ndo_poll_controller = simeth_ndo_poll_controller,*/
+#endif
+};
+
+static inline uint8_t simeth_mac_byte (int i)
+{
+	static uint8_t _dummy_simeth_mac[] = {0x80, 0xce, 0x62, 0x10, 0x95, 0x2c};
+	/* TODO - Prep a hw register set to allow read actual MAC
+	 * and remove the dummy eth mac stuff! */
+	return _dummy_simeth_mac[i];
+}
+
+typedef struct simeth_qstat_desc {
+	char name[ETH_GSTRING_LEN];
+	size_t offset;
+} simeth_qstat_desc_t;
+
+#define SIMETH_QSTAT(name, field) { name, offsetof (simeth_q_t, field) }
+
+/*per txq counters; name gets the q index prefixed as txq<n>_, or
+ *xdpq<n>_ for the xdp tx qs, where drops are ndo_xdp_xmit frames*/
+static const simeth_qstat_desc_t simeth_txq_stats[] = {
+	SIMETH_QSTAT ("packets", n_pkts),
+	SIMETH_QSTAT ("doorbells", n_doorbells),
+	SIMETH_QSTAT ("drops", n_drops),
+};
+#define SIMETH_N_TXQ_STATS ARRAY_SIZE (simeth_txq_stats)
+
+/*per rxq counters, as rxq<n>_*/
+static const simeth_qstat_desc_t simeth_rxq_stats[] = {
+	SIMETH_QSTAT ("xdp_drop", n_xdp_drop),
+	SIMETH_QSTAT ("xdp_tx", n_xdp_tx),
+	SIMETH_QSTAT ("xdp_redirect", n_xdp_redirect),
+	SIMETH_QSTAT ("irqs", n_irqs),
+	SIMETH_QSTAT ("irqs_spurious", n_irqs_spurious),
+};
+#define SIMETH_N_RXQ_STATS ARRAY_SIZE (simeth_rxq_stats)
+
+static void simeth_get_drvinfo (struct net_device *netdev, struct ethtool_drvinfo *drvinfo)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	strscpy (drvinfo->driver, MODULENAME, sizeof (drvinfo->driver));
+	strscpy (drvinfo->version, SIMETH_VER_0, sizeof (drvinfo->version));
+	strscpy (drvinfo->bus_info, pci_name (adapter->pcidev), sizeof (drvinfo->bus_info));
+}
+
+static uint32_t simeth_get_msglevel (struct net_device *netdev)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	return adapter->msg_enable;
+}
+
+static void simeth_set_msglevel (struct net_device *netdev, uint32_t data)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	adapter->msg_enable = data;
+}
+
+static int simeth_get_sset_count (struct net_device *netdev, int sset)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	switch (sset) {
+		case ETH_SS_STATS:
+			return (adapter->n_txqs + adapter->n_xdpqs) * SIMETH_N_TXQ_STATS + \
+				adapter->n_rxqs * SIMETH_N_RXQ_STATS;
+		default:
+			return -EOPNOTSUPP;
+	}
+}
+
+static void simeth_get_strings (struct net_device *netdev, uint32_t sset, uint8_t *data)
 {
-	simeth_adapter_t *adapter = (simeth_adapter_t *)cookie;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	int q, i;
 
-	printk (KERN_ALERT "%s\n", __func__); /*Rename this print to simeth_dbg -TODO*/
+	if (sset != ETH_SS_STATS) return;
 
-	/*schedule napi if possible, else reset timer for later scheduling*/
-	if (0/*TODO- remove 0'ing after confirming timer working*/ && \
-			napi_schedule_prep (&adapter->napi)) {
-		napi_schedule (&adapter->napi);
-	} else {
-		mod_timer (&adapter->rxtimer, jiffies + SIMETH_RXTIMER_TMO);
+	for (q = 0; q < adapter->n_txqs; q++) {
+		for (i = 0; i < SIMETH_N_TXQ_STATS; i++) {
+			snprintf (data, ETH_GSTRING_LEN, "txq%d_%s", q, simeth_txq_stats[i].name);
+			data += ETH_GSTRING_LEN;
+		}
+	}
+	for (q = 0; q < adapter->n_xdpqs; q++) {
+		for (i = 0; i < SIMETH_N_TXQ_STATS; i++) {
+			snprintf (data, ETH_GSTRING_LEN, "xdpq%d_%s", q, simeth_txq_stats[i].name);
+			data += ETH_GSTRING_LEN;
+		}
+	}
+	for (q = 0; q < adapter->n_rxqs; q++) {
+		for (i = 0; i < SIMETH_N_RXQ_STATS; i++) {
+			snprintf (data, ETH_GSTRING_LEN, "rxq%d_%s", q, simeth_rxq_stats[i].name);
+			data += ETH_GSTRING_LEN;
+		}
 	}
 }
 
-static irqreturn_t simeth_irqh (int irq, void *cookie)
+static void simeth_get_ethtool_stats (struct net_device *netdev, \
+		struct ethtool_stats *stats, uint64_t *data)
 {
-	simeth_adapter_t *adapter = (simeth_adapter_t *)cookie;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	int q, i;
 
-	if (irq != adapter->pcidev->irq) {
-		simeth_err (intr, "Invalid irqnum: %d. Expected: %d\n", \
-				irq, adapter->pcidev->irq);
-		return IRQ_NONE;
+	for (q = 0; q < adapter->n_txqs; q++) {
+		char *p = (char *)(adapter->txq + q);
+		for (i = 0; i < SIMETH_N_TXQ_STATS; i++) {
+			*data++ = *(uint64_t *)(p + simeth_txq_stats[i].offset);
+		}
+	}
+	for (q = 0; q < adapter->n_xdpqs; q++) {
+		char *p = (char *)SIMETH_XDPQ (adapter, q);
+		for (i = 0; i < SIMETH_N_TXQ_STATS; i++) {
+			*data++ = *(uint64_t *)(p + simeth_txq_stats[i].offset);
+		}
+	}
+	for (q = 0; q < adapter->n_rxqs; q++) {
+		char *p = (char *)(adapter->rxq + q);
+		for (i = 0; i < SIMETH_N_RXQ_STATS; i++) {
+			*data++ = *(uint64_t *)(p + simeth_rxq_stats[i].offset);
+		}
 	}
+}
 
-	/*handle our irq. TODO*/
-	return IRQ_HANDLED;
+static void simeth_get_channels (struct net_device *netdev, struct ethtool_channels *ch)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	/*a tx q and an rx q always come as a pair*/
+	ch->max_combined = adapter->n_vecs ? adapter->n_vecs : SIMETH_MAX_QS;
+	ch->combined_count = adapter->n_txqs;
 }
 
-static int _simeth_setup_irqh (simeth_adapter_t *adapter)
+static int simeth_set_channels (struct net_device *netdev, struct ethtool_channels *ch)
 {
-	int ret = 0;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	bool running = netif_running (netdev);
+	uint32_t n_qs = adapter->n_txqs;
+	int i, ret = 0;
 
-	switch (g_rx_irqtimer) {
-		case 0:
-			/*We use request_threaded_irq later once actual irq comes up*/
-			/*FIXME- Am I right here?*/
-			ret = request_irq (adapter->pcidev->irq, simeth_irqh, \
-					IRQF_SHARED, adapter->netdev->name, adapter);
-			if (ret) {
-				simeth_err (drv, "Couldn't setup irqh for irq: %d\n", \
-						adapter->pcidev->irq);
+	if (!ch->combined_count || ch->rx_count || ch->tx_count || ch->other_count) {
+		return -EINVAL;
+	}
+	if (ch->combined_count == adapter->n_txqs) {
+		return 0;
+	}
+	if (adapter->xsk_qs >> ch->combined_count) {
+		return -EBUSY; /*an AF_XDP socket is bound to a q going away*/
+	}
+	if (netif_is_rxfh_configured (netdev)) {
+		for (i = 0; i < SER_RSS_RETA_SZ; i++) {
+			if (adapter->rss_reta[i] >= ch->combined_count) {
+				return -EBUSY; /*ethtool -X points at a q going away*/
 			}
-			break;
-		case 1: /* go for timer based approach for rx irq, just simulation */
-			simeth_info (drv, "Using timer for rx-irq as g_rx_irqtimer==1\n");
-			setup_timer (&adapter->rxtimer, simeth_rxtimer_cb, (unsigned long)adapter);
-			mod_timer (&adapter->rxtimer, jiffies + SIMETH_RXTIMER_TMO);
-			break;
-		default:
-			simeth_crit (drv, "Invalid value for g_rx_irqtimer(%d). \
-					Valid values: 0(for timers) or 1(for ivshmem-device-irqs)\n");
-			ret = -EINVAL;
-			break;
+		}
 	}
 
-	return ret;
-}
+	/*qs are set up on open, so bounce the device around the change*/
+	if (running) {
+		simeth_down (adapter);
+	}
+	adapter->n_txqs = adapter->n_rxqs = ch->combined_count;
+	if (running) {
+		ret = simeth_ndo_open (netdev);
+	}
 
-static void _simeth_destroy_irqh (simeth_adapter_t *adapter)
-{
-	switch (g_rx_irqtimer) {
-		case 0:
-			/*FIXME- Am I right here?*/
-			free_irq (adapter->pcidev->irq, adapter->netdev);
-			break;
-		case 1: /* go for timer based approach for rx irq, just simulation */
-			del_timer_sync (&adapter->rxtimer);
-			break;
-		default:
-			break;
+	/*don't leave the device half up, go back to the qs it had*/
+	if (ret) {
+		simeth_err (drv, "reopen with %u qs failed: %d\n", ch->combined_count, ret);
+		adapter->n_txqs = adapter->n_rxqs = n_qs;
+		if (simeth_ndo_open (netdev)) {
+			simeth_err (drv, "reopen with %u qs failed too, device stays down\n", n_qs);
+		}
 	}
 
-	return;
+	return ret;
 }
 
-static int simeth_ndo_open (struct net_device *netdev)
+static void simeth_get_ringparam (struct net_device *netdev, struct ethtool_ringparam *ring, \
+		struct kernel_ethtool_ringparam *kring, struct netlink_ext_ack *extack)
 {
-	int ret = 0;
 	simeth_adapter_t *adapter = netdev_priv (netdev);
 
-	simeth_info (drv, "%s\n", __func__);
-
-	/*pm_runtime_get_sync (&pdev->dev);// What am I doing here? -TODO */
+	ring->rx_max_pending = 512;
+	ring->tx_max_pending = 512;
+	ring->rx_pending = g_n_rxds;
+	ring->tx_pending = g_n_txds;
+	kring->tcp_data_split = adapter->rx_hds ? \
+		ETHTOOL_TCP_DATA_SPLIT_ENABLED : ETHTOOL_TCP_DATA_SPLIT_DISABLED;
+}
 
-	netif_carrier_off(netdev);
+static int simeth_set_ringparam (struct net_device *netdev, struct ethtool_ringparam *ring, \
+		struct kernel_ethtool_ringparam *kring, struct netlink_ext_ack *extack)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
 
-	ret = _simeth_setup_txqs (adapter);
-	if (ret) {
-		simeth_err (drv, "_simeth_setup_txqs failed: %d\n", ret);
-		return ret;
+	if ((ring->rx_pending != g_n_rxds) || (ring->tx_pending != g_n_txds)) {
+		NL_SET_ERR_MSG (extack, "ring sizes are set by the g_n_rxds/g_n_txds params");
+		return -EOPNOTSUPP;
 	}
 
-	ret = _simeth_setup_rxqs (adapter);
-	if (ret) {
-		simeth_err (drv, "_simeth_setup_rxqs failed: %d\n", ret);
-		goto do_rel_txqs;
+	adapter->rx_hds = (kring->tcp_data_split == ETHTOOL_TCP_DATA_SPLIT_ENABLED);
+	if (netif_running (netdev)) {
+		_simeth_config_hds (adapter);
 	}
 
-	/*full-power up the phy -TODO*/
-
-	_simeth_setup_irqh (adapter);
-
-	_simeth_config_engines (adapter);
-
-	napi_enable (&adapter->napi);
+	return 0;
+}
 
-	netif_carrier_on(netdev); /*TODO-get a hang of carrier apis!*/
+static int simeth_get_coalesce (struct net_device *netdev, struct ethtool_coalesce *ec, \
+		struct kernel_ethtool_coalesce *kec, struct netlink_ext_ack *extack)
+{
+	simeth_adapter_t *adapter = netdev_priv (netdev);
 
-    return 0;
+	ec->rx_coalesce_usecs = adapter->rx_coal_usecs;
+	ec->rx_max_coalesced_frames = adapter->rx_coal_frames;
+	ec->tx_coalesce_usecs = adapter->tx_coal_usecs;
+	ec->tx_max_coalesced_frames = adapter->tx_coal_frames;
+	ec->use_adaptive_rx_coalesce = adapter->rx_dim;
+	ec->use_adaptive_tx_coalesce = adapter->tx_dim;
 
-do_rel_txqs:
-	_simeth_clean_txqs (adapter);
-    return ret;
+	return 0;
 }
 
-static void __used _simeth_rel_tx_buf (simeth_adapter_t *adapter, simeth_tx_buf_t *buf)
+/* The engine takes new moderation on the fly, at the q's next irq. The
+ * static values only go to the engine while adaptive is off for the qs,
+ * else dim would overwrite them on its next sample */
+static int simeth_set_coalesce (struct net_device *netdev, struct ethtool_coalesce *ec, \
+		struct kernel_ethtool_coalesce *kec, struct netlink_ext_ack *extack)
 {
-	if (buf->dma_addr) {
-		_simeth_dma_unmap_skb (&adapter->pcidev->dev, \
-				buf->dma_addr, buf->n_bytes, DMA_TO_DEVICE);
-		buf->dma_addr = 0;
-	}
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+	bool rx_dim = !!ec->use_adaptive_rx_coalesce, tx_dim = !!ec->use_adaptive_tx_coalesce;
+	bool dim_off = (adapter->rx_dim && !rx_dim) || (adapter->tx_dim && !tx_dim);
+	bool running = netif_running (netdev);
+	int i;
 
-	if (buf->skb) {
-		dev_kfree_skb_any (buf->skb);
-		buf->skb = 0;
+	if ((ec->rx_coalesce_usecs > SER_ITR_USECS_MAX) || (ec->tx_coalesce_usecs > SER_ITR_USECS_MAX) || \
+			(ec->rx_max_coalesced_frames > SER_ITR_FRAMES_MAX) || \
+			(ec->tx_max_coalesced_frames > SER_ITR_FRAMES_MAX)) {
+		NL_SET_ERR_MSG (extack, "usecs and frames go up to 65535");
+		return -EINVAL;
 	}
-}
 
-static void __used _simeth_rel_rx_buf (simeth_adapter_t *adapter, simeth_rx_buf_t *buf)
-{
-	if (buf->dma_addr) {
-		_simeth_dma_unmap_skb (&adapter->pcidev->dev, \
-				buf->dma_addr, buf->n_bytes, DMA_TO_DEVICE);
-		buf->dma_addr = 0;
-	}
+	adapter->rx_coal_usecs = ec->rx_coalesce_usecs;
+	adapter->rx_coal_frames = ec->rx_max_coalesced_frames;
+	adapter->tx_coal_usecs = ec->tx_coalesce_usecs;
+	adapter->tx_coal_frames = ec->tx_max_coalesced_frames;
 
-	if (buf->skb) {
-		dev_kfree_skb_any (buf->skb);
-		buf->skb = 0;
+	for (i = 0; running && (i < adapter->n_rxqs); i++) {
+		if (rx_dim && !adapter->rx_dim) {
+			_simeth_reset_dim (adapter->rxq + i, 1);
+		}
+		if (tx_dim && !adapter->tx_dim) {
+			_simeth_reset_dim (adapter->txq + i, 0);
+		}
 	}
-}
+	WRITE_ONCE (adapter->rx_dim, rx_dim);
+	WRITE_ONCE (adapter->tx_dim, tx_dim);
 
-static void _simeth_clean_q (simeth_adapter_t *adapter, simeth_q_t *q, int is_rxq)
-{
-	void *buf = q->bring;
-	int i;
+	if (!running) {
+		return 0;
+	}
 
-	if (is_rxq) {
-		for (i = 0; i < q->n_desc; i++) {
-			_simeth_rel_rx_buf (adapter, buf + i);
-		}
-	} else {
-		for (i = 0; i < q->n_desc; i++) {
-			_simeth_rel_rx_buf (adapter, buf + i);
+	if (dim_off) {
+		/*napi polls that still saw dim on are over after this, then
+		 *no dim work is left to overwrite what's set below*/
+		synchronize_net ();
+		for (i = 0; i < adapter->n_rxqs; i++) {
+			cancel_work_sync (&adapter->rxq[i].dim.work);
+			cancel_work_sync (&adapter->txq[i].dim.work);
 		}
 	}
+	for (i = 0; !rx_dim && (i < adapter->n_rxqs); i++) {
+		_simeth_config_coal (adapter, adapter->rxq + i, 1);
+	}
+	for (i = 0; !tx_dim && (i < adapter->n_txqs); i++) {
+		_simeth_config_coal (adapter, adapter->txq + i, 0);
+	}
+	for (i = 0; i < adapter->n_xdpqs; i++) {
+		_simeth_config_coal (adapter, SIMETH_XDPQ (adapter, i), 0);
+	}
+
+	return 0;
 }
 
-static void _simeth_clean_txqs (simeth_adapter_t *adapter)
+static int simeth_get_tunable (struct net_device *netdev, \
+		const struct ethtool_tunable *tuna, void *data)
 {
-	int i;
-	simeth_txq_t *txq = adapter->txq;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
 
-	for (i = 0; i < adapter->n_txqs; i++) {
-		_simeth_clean_txq (adapter, txq + i);
+	switch (tuna->id) {
+		case ETHTOOL_RX_COPYBREAK:
+			*(uint32_t *)data = adapter->rx_copybreak;
+			return 0;
+		default:
+			return -EOPNOTSUPP;
 	}
 }
 
-static void _simeth_clean_rxqs (simeth_adapter_t *adapter)
+static int simeth_set_tunable (struct net_device *netdev, \
+		const struct ethtool_tunable *tuna, const void *data)
 {
-	int i;
-	simeth_rxq_t *rxq = adapter->rxq;
+	simeth_adapter_t *adapter = netdev_priv (netdev);
 
-	for (i = 0; i < adapter->n_rxqs; i++) {
-		_simeth_clean_rxq (adapter, rxq + i);
+	switch (tuna->id) {
+		case ETHTOOL_RX_COPYBREAK:
+			/*napi picks it up on its next poll*/
+			WRITE_ONCE (adapter->rx_copybreak, *(const uint32_t *)data);
+			return 0;
+		default:
+			return -EOPNOTSUPP;
 	}
 }
 
-static void _simeth_stop_sw (simeth_adapter_t *adapter)
+static int simeth_get_rxnfc (struct net_device *netdev, \
+		struct ethtool_rxnfc *cmd, uint32_t *rule_locs)
 {
-	/*If tasklets/workqueues are set, cancel'em all -TODO*/
+	simeth_adapter_t *adapter = netdev_priv (netdev);
+
+	switch (cmd->cmd) {
+		case ETHTOOL_GRXRINGS:
+			cmd->data = adapter->n_rxqs;
+			return 0;
+		default:
+			return -EOPNOTSUPP;
+	}
 }
 
-static void simeth_down (simeth_adapter_t *adapter)
+static uint32_t simeth_get_rxfh_key_size (struct net_device *netdev)
 {
-	struct net_device *netdev = adapter->netdev;
-
-	netif_carrier_off (netdev);
-
-	_simeth_destroy_irqh (adapter);
-
-	/*Disable rx engine - write stop to rxctl -TODO*/
-
-	netif_tx_disable (netdev);
-
-	/*Disable tx engine -write stop to tcxtl -TODO*/
-	msleep (10);
-
-	napi_disable (&adapter->napi);
-
-	_simeth_irq_disable (adapter);
-
-	_simeth_stop_sw (adapter);
-
-	_simeth_reset_hw (adapter);
-
-	_simeth_clean_txqs (adapter);
-	_simeth_clean_rxqs (adapter);
+	return SER_RSS_KEY_SZ;
 }
 
-static int simeth_ndo_stop (struct net_device *netdev)
+static uint32_t simeth_get_rxfh_indir_size (struct net_device *netdev)
 {
-	int ret = 0;
-	simeth_adapter_t *adapter = netdev_priv (netdev);
-
-	simeth_info (drv, "%s\n", __func__);
-
-	simeth_down (adapter);
-
-    return ret;
+	return SER_RSS_RETA_SZ;
 }
 
-static netdev_tx_t simeth_ndo_start_xmit (struct sk_buff *skb, struct net_device *netdev)
+static int simeth_get_rxfh (struct net_device *netdev, struct ethtool_rxfh_param *rxfh)
 {
-	int ret = 0, txst = 0;
 	simeth_adapter_t *adapter = netdev_priv (netdev);
-	struct simeth_pcpustats *cpstats = &adapter->cpstats;
-
-    if (!skb) return (netdev_tx_t)0;
-
-	simeth_info (drv, "%s\n", __func__);
+	int i;
 
-#if XMIT_IS_REAL
-	if (simeth_xmit_mac_fn) {
-		ret = simeth_xmit_mac_fn (skb);
-		if (ret < 0) {/*check for -1/-2,etc err cases*/
-			simeth_err (tx_err, "in simeth_xmit_mac, ret: %d\n", ret);
-			txst = ret;
-			ret = NETDEV_TX_BUSY;
+	rxfh->hfunc = ETH_RSS_HASH_TOP;
+	if (rxfh->indir) {
+		for (i = 0; i < SER_RSS_RETA_SZ; i++) {
+			rxfh->indir[i] = adapter->rss_reta[i];
 		}
 	}
-#endif
-
-	/* We may have to see if we need a work-scheduling/sync
-	 * In case we do, lot of changes follow this line -TODO */
-	if (!ret) { /* tx success */
-		cpstats->tx_stats.packets += 1;
-		cpstats->tx_stats.bytes += skb->len;
-	} else { /* tx failed */
-		switch (txst) {
-			case -1: cpstats->tx_stats.dropped += 1; break;
-			case -2: cpstats->tx_stats.errors += 1; break;
-			default: simeth_err (tx_err, "%s txst: %d\n", __func__, txst);
-					 break;
-		}
+	if (rxfh->key) {
+		memcpy (rxfh->key, adapter->rss_key, SER_RSS_KEY_SZ);
 	}
 
-	dev_kfree_skb (skb);
-
-    return ret;
+	return 0;
 }
 
-static void simeth_ndo_get_stats64 (struct net_device *netdev, struct rtnl_link_stats64 *showstats)
+static int simeth_set_rxfh (struct net_device *netdev, struct ethtool_rxfh_param *rxfh, \
+		struct netlink_ext_ack *extack)
 {
-	uint32_t start;
 	simeth_adapter_t *adapter = netdev_priv (netdev);
+	int i;
 
-	/*This log should be seen in dmesg with level 8 on printk in proc -TODO*/
-	simeth_dbg ("%s\n", __func__);
+	/*engine only does toeplitz*/
+	if ((rxfh->hfunc != ETH_RSS_HASH_NO_CHANGE) && (rxfh->hfunc != ETH_RSS_HASH_TOP)) {
+		return -EOPNOTSUPP;
+	}
 
-	do {
-		start = u64_stats_fetch_begin_irq (&adapter->cpstats.rx_stats.syncp);
-		showstats->rx_packets = adapter->cpstats.rx_stats.packets;
-		showstats->rx_bytes = adapter->cpstats.rx_stats.bytes;
-	} while (u64_stats_fetch_retry_irq (&adapter->cpstats.rx_stats.syncp, start));
+	if (rxfh->indir) {
+		for (i = 0; i < SER_RSS_RETA_SZ; i++) {
+			if (rxfh->indir[i] >= adapter->n_rxqs) {
+				NL_SET_ERR_MSG (extack, "indirection table entry past the rx qs in use");
+				return -EINVAL;
+			}
+		}
+		for (i = 0; i < SER_RSS_RETA_SZ; i++) {
+			adapter->rss_reta[i] = rxfh->indir[i];
+		}
+	}
+	if (rxfh->key) {
+		memcpy (adapter->rss_key, rxfh->key, SER_RSS_KEY_SZ);
+	}
 
-	do {
-		start = u64_stats_fetch_begin_irq (&adapter->cpstats.tx_stats.syncp);
-		showstats->tx_packets = adapter->cpstats.tx_stats.packets;
-		showstats->tx_bytes = adapter->cpstats.tx_stats.bytes;
-	} while (u64_stats_fetch_retry_irq(&adapter->cpstats.tx_stats.syncp, start));
+	/*engine reads key and table per frame, no need to stop the qs*/
+	if (netif_running (netdev)) {
+		_simeth_config_rss (adapter);
+	}
 
-	showstats->rx_dropped   = netdev->stats.rx_dropped;
-	showstats->tx_dropped   = netdev->stats.tx_dropped;
-	showstats->rx_length_errors = netdev->stats.rx_length_errors;
-	showstats->rx_errors    = netdev->stats.rx_errors;
-	showstats->rx_crc_errors    = netdev->stats.rx_crc_errors;
-	showstats->rx_fifo_errors   = netdev->stats.rx_fifo_errors;
-	showstats->rx_missed_errors = netdev->stats.rx_missed_errors;
+	return 0;
 }
 
-static const struct net_device_ops simeth_netdev_ops = {
-	.ndo_open = simeth_ndo_open,
-	.ndo_stop = simeth_ndo_stop,
-	.ndo_get_stats64 = simeth_ndo_get_stats64,
-	.ndo_start_xmit = simeth_ndo_start_xmit,
-	/*.ndo_tx_timeout = simeth_ndo_tx_timeout,*/
-	/*.ndo_validate_addr = simeth_ndo_validate_addr,*/
-	/*.ndo_change_mtu = simeth_ndo_change_mtu,*/
-	/*.ndo_set_mac_address = simeth_ndo_set_mac_address,*/
-	/*.ndo_do_ioctl = simeth_ndo_do_ioctl,*/
-	/*.ndo_set_rx_mode = simeth_ndo_set_rx_mode,*/
-#ifdef CONFIG_NET_POLL_CONTROLLER
-	/*.ndo_poll_controller = simeth_ndo_poll_controller,*/
-#endif
+static const struct ethtool_ops simeth_ethtool_ops = {
+	.supported_ring_params = ETHTOOL_RING_USE_TCP_DATA_SPLIT,
+	.supported_coalesce_params = ETHTOOL_COALESCE_USECS | ETHTOOL_COALESCE_MAX_FRAMES | \
+		ETHTOOL_COALESCE_USE_ADAPTIVE,
+	.get_drvinfo = simeth_get_drvinfo,
+	.get_link = ethtool_op_get_link,
+	.get_msglevel = simeth_get_msglevel,
+	.set_msglevel = simeth_set_msglevel,
+	.get_sset_count = simeth_get_sset_count,
+	.get_strings = simeth_get_strings,
+	.get_ethtool_stats = simeth_get_ethtool_stats,
+	.get_ringparam = simeth_get_ringparam,
+	.set_ringparam = simeth_set_ringparam,
+	.get_coalesce = simeth_get_coalesce,
+	.set_coalesce = simeth_set_coalesce,
+	.get_channels = simeth_get_channels,
+	.set_channels = simeth_set_channels,
+	.get_tunable = simeth_get_tunable,
+	.set_tunable = simeth_set_tunable,
+	.get_rxnfc = simeth_get_rxnfc,
+	.get_rxfh_key_size = simeth_get_rxfh_key_size,
+	.get_rxfh_indir_size = simeth_get_rxfh_indir_size,
+	.get_rxfh = simeth_get_rxfh,
+	.set_rxfh = simeth_set_rxfh,
 };
 
-static inline uint8_t simeth_mac_byte (int i)
-{
-	static uint8_t _dummy_simeth_mac[] = {0x80, 0xce, 0x62, 0x10, 0x95, 0x2c};
-	/* TODO - Prep a hw register set to allow read actual MAC
-	 * and remove the dummy eth mac stuff! */
-	return _dummy_simeth_mac[i];
-}
-
 static void _setup_ethtool_ops (struct net_device *netdev)
 {
-	simeth_adapter_t *adapter = netdev_priv (netdev);
-	simeth_info (probe, "%s TODO\n", __func__); /*TODO - setup ethtool ops*/
+	netdev->ethtool_ops = &simeth_ethtool_ops;
 }
 
 static void _simeth_release_qs (simeth_adapter_t *adapter)
@@ -623,24 +2695,18 @@ static void _simeth_release_qs (simeth_adapter_t *adapter)
 
 static int _simeth_alloc_qs (simeth_adapter_t *adapter)
 {
-	/*Only 1 txq/rxq supported*/
-	if (unlikely (adapter->n_txqs != 1)) {
-		simeth_crit (drv, "n_txqs(%d) != 1\n", adapter->n_txqs);
-		return -EINVAL;
-	}
-	if (unlikely (adapter->n_rxqs != 1)) {
-		simeth_crit (drv, "n_rxqs(%d) != 1\n", adapter->n_rxqs);
-		return -EINVAL;
-	}
+	int i;
 
-	adapter->txq = kcalloc (adapter->n_txqs, 
+	/*all SIMETH_MAX_QS are allocated up front, ethtool -L only
+	 *changes how many of them are in use*/
+	adapter->txq = kcalloc (SER_MAX_TXQS, 
 			sizeof (simeth_txq_t), GFP_KERNEL);
 	if (!adapter->txq) {
 		simeth_err (probe, "kcalloc (adapter->txq) failed\n");
 		return -ENOMEM;
 	}
 
-	adapter->rxq = kcalloc (adapter->n_rxqs, 
+	adapter->rxq = kcalloc (SIMETH_MAX_QS, 
 			sizeof (simeth_rxq_t), GFP_KERNEL);
 	if (!adapter->rxq) {
 		simeth_err (probe, "kcalloc (adapter->rxq) failed\n");
@@ -648,36 +2714,107 @@ static int _simeth_alloc_qs (simeth_adapter_t *adapter)
 		return -ENOMEM;
 	}
 
+	for (i = 0; i < SER_MAX_TXQS; i++) {
+		u64_stats_init (&adapter->txq[i].stats.syncp);
+	}
+	for (i = 0; i < SIMETH_MAX_QS; i++) {
+		u64_stats_init (&adapter->rxq[i].stats.syncp);
+	}
+
 	return 0;
 }
 
-static void __used _simeth_irq_enable (simeth_adapter_t *adapter)
+/* One msi-x vector per q pair, which ivshmem-doorbell has as many of as
+ * qemu's vectors= gives it; qs are capped to the vectors there are. With
+ * none (ivshmem-plain, or g_rx_irqtimer) napi runs off poll timers */
+static void _simeth_setup_vecs (simeth_adapter_t *adapter)
+{
+	struct pci_dev *pcidev = adapter->pcidev;
+	void __iomem *ivshmem_regs;
+	int n;
+
+	adapter->n_vecs = 0;
+	if (g_rx_irqtimer) {
+		return;
+	}
+
+	ivshmem_regs = pci_iomap (pcidev, SIMETH_BAR_0, 0);
+	if (!ivshmem_regs) {
+		simeth_warn (probe, "no ivshmem registers, polling off timers\n");
+		return;
+	}
+	adapter->ivshmem_peer = simeth_r32 (ivshmem_regs + SIMETH_IVSHMEM_IVPOSITION);
+	pci_iounmap (pcidev, ivshmem_regs);
+
+	n = pci_alloc_irq_vectors (pcidev, 1, SIMETH_MAX_QS, PCI_IRQ_MSIX);
+	if (n < 0) {
+		simeth_warn (probe, "no msi-x vectors (%d), polling off timers\n", n);
+		return;
+	}
+	adapter->n_vecs = n;
+	adapter->n_txqs = adapter->n_rxqs = min_t (uint32_t, adapter->n_rxqs, n);
+	simeth_info (probe, "%d msi-x vectors, ivshmem peer %u\n", n, adapter->ivshmem_peer);
+}
+
+/* Unmask the vector of every q pair in use; anything that came in while
+ * they were masked is signalled right after. Without vectors, start the
+ * poll timers: a napi_schedule before napi_enable would be lost, and the
+ * timer with it */
+static void _simeth_irq_enable (simeth_adapter_t *adapter)
 {
-	/* TODO - reset mask bit or do something similar
-	 * to enable interrupt generation on this device */
-	/*writel and then readl*/
+	int i;
+
+	if (!adapter->n_vecs) {
+		for (i = 0; i < adapter->n_rxqs; i++) {
+			hrtimer_start (&adapter->rxq[i].poll_timer, \
+					us_to_ktime (adapter->rxq[i].poll_usecs), HRTIMER_MODE_REL_PINNED);
+		}
+		return;
+	}
+
+	for (i = 0; i < adapter->n_vecs; i++) {
+		simeth_w32 (adapter->ioaddr + SER_IRQ_VEC_ACK (i), \
+				simeth_r32 (adapter->ioaddr + SER_IRQ_VEC_CAUSE (i)));
+		simeth_vec_unmask (adapter, i);
+	}
 }
 
 static void _simeth_irq_disable (simeth_adapter_t *adapter)
 {
-	/* TODO - set mask bit or do something similar
-	 * to disable interrupt generation on this device */
-	/*writel and then readl*/
-	/*synchronize_irq (adapter->pcidev->irq);*/
+	int i;
+
+	for (i = 0; i < adapter->n_vecs; i++) {
+		simeth_vec_mask (adapter, i);
+	}
+	if (adapter->n_vecs) {
+		simeth_r32 (adapter->ioaddr + SER_IRQ_CTRL); /*flush posted writes*/
+	}
 }
 
 static int _simeth_setup_adapter (simeth_adapter_t *adapter)
 {
 	int ret = 0;
 
-	adapter->rx_buflen = MAX_ETH_VLAN_SZ;
+	adapter->rx_buflen = SIMETH_RX_BUFLEN (adapter->netdev->mtu);
+	adapter->rx_copybreak = g_rx_copybreak;
+	adapter->rx_hds = !!g_rx_hds;
+	adapter->rx_coal_usecs = SIMETH_RX_COAL_USECS;
+	adapter->rx_coal_frames = SIMETH_RX_COAL_FRAMES;
+	adapter->tx_coal_usecs = SIMETH_TX_COAL_USECS;
+	adapter->tx_coal_frames = SIMETH_TX_COAL_FRAMES;
+	adapter->rx_dim = true;
+
+	netdev_rss_key_fill (adapter->rss_key, sizeof (adapter->rss_key));
 
-	adapter->n_txqs = 1;
-	adapter->n_rxqs = 1;
+	adapter->n_txqs = g_n_qs ? g_n_qs : \
+		min_t (uint32_t, netif_get_num_default_rss_queues (), SIMETH_MAX_QS);
+	adapter->n_rxqs = adapter->n_txqs;
 
 	ret = _simeth_alloc_qs (adapter);
 	if (ret) return ret;
 
+	_simeth_setup_vecs (adapter);
+
 	_simeth_irq_disable (adapter);
 	return ret;
 }
@@ -721,8 +2858,8 @@ static int _simeth_get_valid_mac_addr (simeth_adapter_t *adapter)
 static void _simeth_adjust_descq_count (void)
 {
 	if (unlikely ((g_n_txds < 32) || (g_n_txds > 512))) {
-		pr_warn ("Param n_txds(%u) out of range(32 to 512). Defaulting to 64\n", g_n_txds);
-		g_n_txds = 64;
+		pr_warn ("Param n_txds(%u) out of range(32 to 512). Defaulting to 256\n", g_n_txds);
+		g_n_txds = 256;
 	} else if (unlikely (g_n_txds % SIMETH_DESC_RING_ALIGNER)) {
 		uint32_t _adjust = g_n_txds - (g_n_txds % SIMETH_DESC_RING_ALIGNER);
 		pr_warn ("Param n_txds(%u) is not aligned to %lu. Rounding down to: %u\n", \
@@ -738,6 +2875,26 @@ static void _simeth_adjust_descq_count (void)
 				g_n_rxds, SIMETH_DESC_RING_ALIGNER, _adjust);
 		g_n_rxds = _adjust;
 	}
+	if (unlikely (!g_napi_weight || (g_napi_weight > NAPI_POLL_WEIGHT))) {
+		pr_warn ("Param napi_weight(%u) out of range(1 to %u). Defaulting to %u\n", \
+				g_napi_weight, NAPI_POLL_WEIGHT, SIMETH_NAPI_WEIGHT);
+		g_napi_weight = SIMETH_NAPI_WEIGHT;
+	}
+	if (unlikely (!g_rsc_max_len || (g_rsc_max_len > SIMETH_RSC_MAX_LEN))) {
+		pr_warn ("Param rsc_max_len(%u) out of range(1 to %u). Defaulting to %u\n", \
+				g_rsc_max_len, SIMETH_RSC_MAX_LEN, SIMETH_RSC_MAX_LEN);
+		g_rsc_max_len = SIMETH_RSC_MAX_LEN;
+	}
+	if (unlikely (g_rsc_flush_us > SIMETH_RSC_FLUSH_US_MAX)) {
+		pr_warn ("Param rsc_flush_us(%u) out of range(0 to %u). Defaulting to %u\n", \
+				g_rsc_flush_us, SIMETH_RSC_FLUSH_US_MAX, SIMETH_RSC_FLUSH_US);
+		g_rsc_flush_us = SIMETH_RSC_FLUSH_US;
+	}
+	if (unlikely (g_n_qs > SIMETH_MAX_QS)) {
+		pr_warn ("Param n_qs(%u) out of range(0 to %u). Using %u\n", g_n_qs, \
+				SIMETH_MAX_QS, SIMETH_MAX_QS);
+		g_n_qs = SIMETH_MAX_QS;
+	}
 }
 
 static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
@@ -755,7 +2912,7 @@ static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
 
 	_simeth_adjust_descq_count ();
 
-    netdev = alloc_etherdev (sizeof (*adapter));
+    netdev = alloc_etherdev_mqs (sizeof (*adapter), SIMETH_MAX_QS, SIMETH_MAX_QS);
     if (!netdev) {
         pr_err ("Failed alloc-ether-simeth-dev\n");
         return -ENOMEM;
@@ -805,24 +2962,33 @@ static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
 
 	/* pci-dma-mask-settings, even this's simeth just try
 	 * setting dma-mask and discard errors for time being */
-	ret = pci_set_dma_mask (pcidev, DMA_BIT_MASK (64));
+	ret = dma_set_mask_and_coherent (&pcidev->dev, DMA_BIT_MASK (64));
 	if (ret < 0) {
-		simeth_warn (probe, "error pci_set_dma_mask-64: %d", ret);
-		ret = pci_set_dma_mask (pcidev, DMA_BIT_MASK (32));
+		simeth_warn (probe, "error dma_set_mask-64: %d", ret);
+		ret = dma_set_mask_and_coherent (&pcidev->dev, DMA_BIT_MASK (32));
 		if (ret < 0) {
-			simeth_warn (probe, "error pci_set_dma_mask-32: %d", ret);
+			simeth_warn (probe, "error dma_set_mask-32: %d", ret);
 			/*goto do_dis_dev;*/
 		}
 	}
 
-	/* ioremap here */
-	ioaddr = ioremap (pci_resource_start(pcidev, 2), \
-			pci_resource_len (pcidev, 2));
+	/* registers are the only uncached part of the bar, rings and
+	 * buffer pools after them are plain shared memory */
+	ioaddr = ioremap (pci_resource_start (pcidev, nic_bar_idx), SER_BAR_REGS_SZ);
 	if (!ioaddr) {
 		simeth_err (probe, "Error ioremap-simethnet\n");
 		ret = -ENOMEM;
 		goto do_rel_regions;
 	}
+	adapter->ioaddr = ioaddr;
+
+	adapter->bar_mem = memremap (pci_resource_start (pcidev, nic_bar_idx) + \
+			SER_BAR_DRING_OFF, SIMETH_BAR_SZ - SER_BAR_DRING_OFF, MEMREMAP_WB);
+	if (!adapter->bar_mem) {
+		simeth_err (probe, "Error memremap-simethnet\n");
+		ret = -ENOMEM;
+		goto do_iounmap;
+	}
 
 	/* set bus-mastering for the device */
 	pci_set_master (pcidev);
@@ -833,16 +2999,12 @@ static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
 		goto do_clear_master;
 	}
 
-	adapter->ioaddr = ioaddr;
-
 	/* get valid MAC Address or get out of here */
 	if (_simeth_get_valid_mac_addr (adapter) == 0) {
-		memcpy (adapter->netdev->dev_addr, adapter->mac_addr, ETH_ALEN);
+		eth_hw_addr_set (adapter->netdev, adapter->mac_addr);
 	}
 	_setup_ethtool_ops (netdev);
 
-	netif_napi_add (netdev, &adapter->napi, simeth_napi_rxpoll, SIMETH_NAPI_WEIGHT);
-
 	/*netdev->watchdog_timeo = 5*HZ; TODO - add tx-timeout handler*/
 
 	pci_set_drvdata (pcidev, netdev);
@@ -850,17 +3012,26 @@ static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
 	ret = _simeth_setup_adapter (adapter);
     if (ret < 0) {
         simeth_crit (probe, "Failed adapter_setup: %d\n", ret);
-		goto do_napi_del;
+		goto do_clear_master;
     }
 
 	_simeth_init_mdio_ops (adapter);
 
 	_simeth_init_hw (adapter);
 
-	/*setup hardware feature flags someday! -TODO*/
-	netdev->features = 0;
-	netdev->hw_features = 0;
+	/* tx skbs go out as desc chains, so no need to linearize frags.
+	 * TSO and csum (generic csum_start/offset) are done by the engine,
+	 * which also hands us the rss hash and csum status of rx frames */
+	netdev->hw_features = NETIF_F_SG | NETIF_F_HW_CSUM | \
+		NETIF_F_TSO | NETIF_F_TSO6 | NETIF_F_RXHASH | NETIF_F_RXCSUM | NETIF_F_LRO;
+	netdev->features = netdev->hw_features;
 	netdev->vlan_features = 0;
+	/*XSK_ZEROCOPY is the only way the stack hands a umem to the driver
+	 *(XDP_SETUP_XSK_POOL); without it AF_XDP falls back to generic copy
+	 *mode through skbs. The engine only reaches the BAR, so frames are
+	 *still copied once between a BAR slot and the umem, see README*/
+	netdev->xdp_features = NETDEV_XDP_ACT_BASIC | NETDEV_XDP_ACT_REDIRECT | \
+		NETDEV_XDP_ACT_NDO_XMIT | NETDEV_XDP_ACT_XSK_ZEROCOPY;
 
 	/*set minimum and maximum mtu values for this netdev*/
 	netdev->min_mtu = ETH_ZLEN - ETH_HLEN;
@@ -887,17 +3058,27 @@ static int simeth_probe (struct pci_dev *pcidev, const struct pci_device_id *id)
 	/*TODO- Disable carrier, we'll enable after ifup happens via open call*/
 	netif_carrier_off(netdev);
 
+	if (g_napi_threaded) {
+		/*napis are added on open, they pick their kthread up then*/
+		rtnl_lock ();
+		ret = dev_set_threaded (netdev, true);
+		rtnl_unlock ();
+		if (ret) {
+			simeth_warn (probe, "threaded napi unavailable: %d\n", ret);
+			ret = 0;
+		}
+	}
+
 	simeth_info (probe, "simeth setup done!");
 
 	return 0;
 
 do_clean_adapter:
 	_simeth_clean_adapter (adapter);
-do_napi_del:
-	netif_napi_del (&adapter->napi);
 do_clear_master:
 	pci_clear_master (pcidev);
-/*do_iounmap:*/
+	memunmap (adapter->bar_mem);
+do_iounmap:
 	iounmap (adapter->ioaddr);
 do_rel_regions:
 	pci_release_regions (pcidev);
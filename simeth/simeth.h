@@ -2,38 +2,51 @@
 #ifndef __SIMETH_H
 #define __SIMETH_H
 
+#include <linux/version.h>
 #include <linux/types.h>
 #include <linux/list.h>
-#include <linux/timer.h>
+#include <linux/hrtimer.h>
+#include <linux/llist.h>
 #include <linux/u64_stats_sync.h>
 #include <linux/netdevice.h>
+#include <net/xdp.h>
 
 #include "simeth_nic.h"
 
+/* Oldest kernel simeth builds against, for hrtimer_setup */
+#if LINUX_VERSION_CODE < KERNEL_VERSION (6, 13, 0)
+#error "simeth needs linux 6.13 or later"
+#endif
+
 /* simeth driver version */
 #define SIMETH_VER_0 "0.1"
 
-/* If a real xmit is going to happen, this shall be 1, else 0 (dummy) */
-#define XMIT_IS_REAL 1
-
-/* If we need actual dma_mapping of skbs, set to 1, else reset to 0 (dummy) */
-#define SIMETH_EN_DMA_MAPS 0
-
-/* NAPI Poll weight */
-#define SIMETH_NAPI_WEIGHT 1
+/* Default NAPI poll weight, see g_napi_weight */
+#define SIMETH_NAPI_WEIGHT NAPI_POLL_WEIGHT
 
 /* pci_device_id structure entry macro */
 #define simeth_pci_dev_id(vend, dev, drv_data) \
 { PCI_DEVICE(vend, dev), .driver_data = drv_data, }
 
 /* Minimum size of the IVSHMEM bar for simeth to function as expected */
-#define SIMETH_BAR_SZ (512 * 1024 * 1024)
+#define SIMETH_BAR_SZ SER_BAR_SZ
+
+/* Kernel address of a BAR offset in the memremap'd (non-register) part */
+#define SIMETH_BAR_VA(a, off) ((a)->bar_mem + ((off) - SER_BAR_DRING_OFF))
 
 /* Maximum size of rx buffer with VLAN tag generally 1518 + 4 */
 #define MAX_ETH_VLAN_SZ 1522
 
-/* Maximum jumbo frame size including all types of headers */
-#define MAX_JUMBO_FRAME_SIZE 4096
+/* Maximum jumbo frame size including all types of headers, i.e. a 9000
+ * mtu plus ethernet header, vlan tag and fcs. Frames above a BAR slot go
+ * as desc chains both ways */
+#define MAX_JUMBO_FRAME_SIZE 9022
+
+/* Rx buffer length posted per desc for an mtu: a standard frame fits one
+ * desc, jumbo frames are chained over full BAR slots */
+#define SIMETH_RX_BUFLEN(mtu) \
+	(((mtu) + ETH_HLEN + VLAN_HLEN + ETH_FCS_LEN <= MAX_ETH_VLAN_SZ) ? \
+	 MAX_ETH_VLAN_SZ : SER_BAR_BUF_SZ)
 
 /* Desc count alignment
  * Mind cache lines, alignment for io desc & result desc ring bases
@@ -42,6 +55,77 @@
 
 #define SIMETH_DESC_RING_ALIGNER (SIMETH_DMA_REGION_ALIGNER / sizeof (simeth_desc_t))
 
+/* Number of descs a q can still hand over to the engine (one's kept empty) */
+#define SIMETH_DESC_UNUSED(q) \
+	((((q)->txdh > (q)->txdt) ? 0 : (q)->n_desc) + (q)->txdh - (q)->txdt - 1)
+
+/* Next desc index in a q, wrapping around at n_desc */
+#define SIMETH_DESC_NEXT(q, i) (((i) + 1 == (q)->n_desc) ? 0 : (i) + 1)
+
+/* Max bytes put in a single tx desc, i.e. one BAR pool slot */
+#define SIMETH_TX_DLEN_MAX SER_BAR_BUF_SZ
+
+/* Tx descs an skb of len bytes needs, its bytes are packed into slots */
+#define SIMETH_TX_DESCS_FOR(len) DIV_ROUND_UP ((len), SIMETH_TX_DLEN_MAX)
+
+/* Free tx descs required to accept one more skb; tx q stops below this */
+#define SIMETH_TX_DESC_NEEDED(a) ((a)->tx_desc_needed)
+
+/* Free tx descs required before a stopped tx q is woken up again */
+#define SIMETH_TX_WAKE_THRESH(a) (SIMETH_TX_DESC_NEEDED (a) * 2)
+
+/* Bytes of a page_pool frag an rx frame of len bytes is copied into,
+ * headroom and skb_shared_info included so an skb is built around it */
+#define SIMETH_RX_FRAG_SZ(hr, len) \
+	(SKB_DATA_ALIGN ((hr) + (len)) + \
+	 SKB_DATA_ALIGN (sizeof (struct skb_shared_info)))
+#define SIMETH_RX_HEADROOM (NET_SKB_PAD + NET_IP_ALIGN)
+#define SIMETH_RX_XDP_HEADROOM XDP_PACKET_HEADROOM
+
+/* Default rx copybreak, frames below it are copied into a small napi skb */
+#define SIMETH_RX_COPYBREAK 256
+
+/* Rx descs handed back to the engine in one go while polling */
+#define SIMETH_RX_REFILL_BATCH 16
+
+/* Max descs an rx frame may span, its head plus one frag per desc */
+#define SIMETH_RX_CHAIN_MAX (MAX_SKB_FRAGS + 1)
+
+/* Default rsc limits, see g_rsc_max_len and g_rsc_flush_us */
+#define SIMETH_RSC_MAX_LEN 65535
+#define SIMETH_RSC_FLUSH_US 20
+#define SIMETH_RSC_FLUSH_US_MAX 1000
+
+/* Max tx/rx q pairs, each pair has its own register sets and BAR area */
+#define SIMETH_MAX_QS SER_MAX_QS
+
+/* Xdp tx q n, kept in the txq array after the stack's tx qs so
+ * its index is also its engine tx q, see SER_XDP_TXQ */
+#define SIMETH_XDPQ(a, n) ((a)->txq + SER_XDP_TXQ (n))
+
+/* Default irq moderation of each q, ethtool -C; net_dim moves rx qs
+ * off it unless adaptive-rx is turned off */
+#define SIMETH_RX_COAL_USECS 8
+#define SIMETH_RX_COAL_FRAMES 32
+#define SIMETH_TX_COAL_USECS 32
+#define SIMETH_TX_COAL_FRAMES 64
+
+/* IVPosition register of ivshmem in BAR0, our peer id with the server */
+#define SIMETH_IVSHMEM_IVPOSITION 0x08
+
+/* Period of the poll timer that stands in for a q pair's vector, usecs;
+ * it drops to the min as soon as a poll finds work, and doubles up to
+ * the max for each poll that finds none */
+#define SIMETH_POLL_USECS_MIN 4
+#define SIMETH_POLL_USECS_MAX 1000
+
+/* Hold back/let through the msi-x vector of q pair v in the engine */
+#define simeth_vec_mask(a, v)   simeth_w32 ((a)->ioaddr + SER_IRQ_VEC_MASK (v), 1)
+#define simeth_vec_unmask(a, v) simeth_w32 ((a)->ioaddr + SER_IRQ_VEC_MASK (v), 0)
+
+/* Max skbs reclaimed from a tx q in one napi poll */
+#define SIMETH_TX_CLEAN_BUDGET 64
+
 /* error logging function macros for simeth */
 #define simeth_dbg(format, arg...) \
 	netdev_dbg (adapter->netdev, format, ## arg)
@@ -72,24 +156,34 @@ typedef struct simeth_stats {
 	struct u64_stats_sync syncp;
 } simeth_stats_t;
 
-typedef struct simeth_pcpustats {
-	simeth_stats_t tx_stats;
-	simeth_stats_t rx_stats;
-} simeth_pcps_t;
-
-/* simeth tx buf per-sk_buff handler structure */
+/* BAR-resident packet buffer, one SER_BAR_BUF_SZ slot of a q's pool */
+typedef struct simeth_bslot {
+	struct llist_node   node;
+	uint32_t            off; /*device address of the slot, i.e. its BAR offset*/
+} simeth_bslot_t;
+
+/* per-q pool of BAR slots. Slots are freed to the lock-free free list
+ * from any context, only the q owner takes them, via its private cache */
+typedef struct simeth_bpool {
+	simeth_bslot_t      *slots;
+	uint32_t            n_slots;
+	struct llist_head   free;
+	struct llist_node   *cache;
+} simeth_bpool_t;
+
+/* simeth tx buf per-desc handler structure */
 typedef struct simeth_tx_buf {
 	uint64_t            ts; /*timestamp this buf's used*/
-	uint32_t            n_bytes; /*num of bytes for the skb (all frags)*/
-	struct sk_buff      *skb; /*1st sk-buffer */
-	dma_addr_t          dma_addr; /*DMA'ble address for hw*/
+	uint32_t            n_bytes; /*num of skb bytes copied into slot*/
+	struct sk_buff      *skb; /*sk-buffer, held by the eop desc of its chain*/
+	simeth_bslot_t      *slot; /*BAR slot this desc points the engine at*/
 } simeth_tx_buf_t;
 
-/* simeth rx buf per-sk_buff handler structure */
+/* simeth rx buf per-desc handler structure */
 typedef struct simeth_rx_buf {
 	uint32_t            n_bytes; /*num of bytes for the skb (all frags)*/
 	struct sk_buff      *skb; /*1st sk-buffer */
-	dma_addr_t          dma_addr; /*DMA'ble address for hw*/
+	simeth_bslot_t      *slot; /*BAR slot the engine writes to*/
 } simeth_rx_buf_t;
 
 /* simeth tx/rx queue handler structure */
@@ -110,7 +204,10 @@ typedef struct simeth_q {
 	};
 	uint32_t            bring_sz; /*size of buffer ring memory in bytes*/
 
-	dma_addr_t          dring_dma_addr;
+	dma_addr_t          dring_dma_addr; /*device address, i.e. BAR offset*/
+	dma_addr_t          hdr_dma_addr; /*rx: header split buffers, SER_HDS_HDR_SZ per desc*/
+
+	simeth_bpool_t      bpool; /*BAR slots this q's descs point at*/
 
 	void __iomem        *eng_base;
 
@@ -122,6 +219,33 @@ typedef struct simeth_q {
 		uint32_t        txdt;
 		uint32_t        rxdt;
 	};
+	uint32_t            txdt_rung; /*tx: txdt as of the last doorbell*/
+
+	char                irq_name[IFNAMSIZ + 8]; /*rx: of msi-x vector n, which schedules napi*/
+	struct dim          dim; /*adaptive irq moderation, fed from the q pair's napi*/
+	struct hrtimer      poll_timer; /*rx: schedules napi in place of vector n, if none*/
+	uint32_t            poll_usecs; /*rx: its period, see _simeth_poll_rearm*/
+
+	struct page_pool    *page_pool; /*rx: pages frames are copied into*/
+	struct xdp_rxq_info xdp_rxq; /*rx: registered while the q is set up*/
+	struct xsk_buff_pool *xsk_pool; /*rx: AF_XDP umem bound to the q, see _simeth_xsk_setup*/
+	spinlock_t          xdp_tx_lock; /*xdp tx: taken only if cpus share the q*/
+
+	/*sw counters of this q, reported via ethtool -S*/
+	uint64_t            n_pkts; /*pkts handed over to engine*/
+	uint64_t            n_doorbells; /*tail register writes to engine*/
+	uint64_t            n_xdp_drop; /*rx: xdp verdicts, see simeth_rxq_stats*/
+	uint64_t            n_xdp_tx;
+	uint64_t            n_xdp_redirect;
+	uint64_t            n_irqs; /*rx: msi-x irqs of the q pair, also dim's event count*/
+	uint64_t            n_irqs_spurious; /*rx: of those, ones with no new SER_IRQ_VEC_CAUSE*/
+
+	/*fields from here on survive q setup, so counters span down/up*/
+	/*rxq n's napi also reaps txq n, added while the device is up; before
+	 *the rxq is set up, which registers its id with xdp*/
+	struct napi_struct  napi;
+	simeth_stats_t      stats; /*written from napi only*/
+	uint64_t            n_drops; /*skbs dropped in xmit*/
 } simeth_q_t ____cacheline_internodealigned_in_smp;
 
 typedef simeth_q_t simeth_txq_t;
@@ -141,21 +265,32 @@ typedef struct simeth_hw {
 
 /* Main structure containing simeth driver context */
 typedef struct simeth_adapter {
-	simeth_pcps_t       cpstats;
-	struct napi_struct  napi;
 	struct net_device   *netdev;
 	struct pci_dev      *pcidev;
 	simeth_hw_t         hw;
 
-	uint32_t            n_txqs;
+	uint32_t            n_txqs; /*qs in use, ethtool -L; SIMETH_MAX_QS are allocated*/
 	uint32_t            n_rxqs;
-	simeth_q_t          *txq;
+	uint32_t            n_xdpqs; /*one per cpu up to SER_MAX_XDP_QS, while up*/
+	bool                xdpqs_shared; /*more cpus than xdp tx qs, see _simeth_xdpq_get*/
+	bool                xdpqs_up; /*ndo_xdp_xmit/xsk_wakeup may go on, cleared before down*/
+	bool                up; /*qs, napis and irqs set up by open; a failed reopen leaves it clear*/
+	uint32_t            xps_n_txqs; /*q count the default xps map was set for, see _simeth_set_xps*/
+	simeth_q_t          *txq; /*SER_MAX_TXQS, xdp tx qs from SIMETH_XDPQ (a, 0) on*/
 	simeth_q_t          *rxq;
 
-	/* since irq's a bit out of coverage from ivshmem-qemu initially,
-	 * we use timer to emulate interrupt during inital dev stages */
-#define SIMETH_RXTIMER_TMO     (500) /*What is this value? -FIXME*/
-	struct timer_list   rxtimer;
+	struct bpf_prog     *xdp_prog; /*read in napi, swapped under rtnl*/
+	unsigned long       xsk_qs; /*rxqs with an AF_XDP umem, picked up on q setup*/
+
+	uint32_t            n_vecs; /*msi-x vectors, one per q pair; 0 if napi runs off poll_timer*/
+	uint32_t            ivshmem_peer; /*IVPosition, engine signals our vectors on this peer*/
+
+	uint32_t            rx_coal_usecs; /*ethtool -C, SER_DRING_ITR_USECS/FRAMES of each q*/
+	uint32_t            rx_coal_frames;
+	uint32_t            tx_coal_usecs;
+	uint32_t            tx_coal_frames;
+	bool                rx_dim; /*adaptive-rx/tx: net_dim picks the q's moderation instead*/
+	bool                tx_dim;
 
 	/*simeth_stats_t      drv_tx_stats;*/
 	/*simeth_stats_t      drv_rx_stats;*/
@@ -163,8 +298,15 @@ typedef struct simeth_adapter {
 	int                 mode;
 	int                 msg_enable;
 	void __iomem       *ioaddr; /*used for BAR access for nic dma ctrl*/
+	void               *bar_mem; /*rings & pools, BAR from SER_BAR_DRING_OFF on*/
+
+	uint32_t            rx_buflen; /*posted per rx desc, SIMETH_RX_BUFLEN of the mtu*/
+	uint32_t            rx_copybreak; /*g_rx_copybreak, ethtool rx-copybreak tunable*/
+	bool                rx_hds; /*g_rx_hds, ethtool -G tcp-data-split*/
 
-	uint32_t            rx_buflen;
+	uint8_t             rss_key[SER_RSS_KEY_SZ]; /*ethtool -X hkey*/
+	uint8_t             rss_reta[SER_RSS_RETA_SZ]; /*ethtool -X, rxq per hash bucket*/
+	uint32_t            tx_desc_needed; /*worst case descs per skb, see SIMETH_TX_DESCS_FOR*/
 
 	uint8_t             mac_addr[ETH_ALEN];
 } simeth_adapter_t;
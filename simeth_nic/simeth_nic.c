@@ -1,17 +1,205 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include "simeth_nic.h"
+#include "simnic.h"
+
+int simnic_verbose;
+
+static volatile int we_live = 1;
+
+static void simnic_sighandler (int signum)
+{
+	we_live = 0;
+}
+
+uint64_t simnic_now_us (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Translate a device address found in a desc/register to engine's view */
+void *simnic_dev_ptr (simnic_t *nic, uint64_t dev_addr, uint32_t len)
+{
+	if ((dev_addr >= nic->bar_sz) || (len > nic->bar_sz - dev_addr)) {
+		return NULL;
+	}
+	return nic->bar + dev_addr;
+}
+
+/* Latch ring base/size of an enabled q, returns -1 if q's not usable */
+int simnic_q_latch (simnic_t *nic, simnic_q_t *q)
+{
+	uint64_t pa;
+	uint32_t n_desc;
+
+	if (!(simnic_r32 (nic, q->reg_base + SER_DRING_CTRL) & SER_DRING_EN)) {
+		if (q->dring) {
+			simnic_info ("q@0x%x disabled\n", q->reg_base);
+			simnic_w32 (nic, q->reg_base + SER_DRING_ST, 0);
+			q->dring = NULL;
+		}
+		return -1;
+	}
+
+	pa = ((uint64_t)simnic_r32 (nic, q->reg_base + SER_DRING_PA_H) << 32) | \
+		 simnic_r32 (nic, q->reg_base + SER_DRING_PA_L);
+	n_desc = simnic_r32 (nic, q->reg_base + SER_DRING_SZ);
+
+	if (!q->dring || (q->n_desc != n_desc) || \
+			((void *)q->dring != simnic_dev_ptr (nic, pa, 0))) {
+		q->dring = simnic_dev_ptr (nic, pa, n_desc * sizeof (simeth_desc_t));
+		q->n_desc = n_desc;
+		if (!q->dring || !n_desc) {
+			simnic_dbg ("q@0x%x bad ring pa: 0x%lx n_desc: %u\n", \
+					q->reg_base, pa, n_desc);
+			q->dring = NULL;
+			return -1;
+		}
+		simnic_info ("q@0x%x enabled, ring pa: 0x%lx n_desc: %u\n", \
+				q->reg_base, pa, n_desc);
+		simnic_w32 (nic, q->reg_base + SER_DRING_ST, SER_DRING_EN);
+	}
+
+	return 0;
+}
+
+/* Put a frame on the wire; there's no wire yet, frames are counted/dumped
+ * and with loopback on, received back on the rxq rss picks */
+int simnic_wire_xmit (simnic_t *nic, uint8_t *frame, uint32_t len)
+{
+	nic->wire_pkts++;
+	nic->wire_bytes += len;
+
+	if (simnic_verbose) {
+		simnic_dbg ("wire: %u bytes, dst %02x:%02x:%02x:%02x:%02x:%02x\n", len, \
+				frame[0], frame[1], frame[2], frame[3], frame[4], frame[5]);
+	}
+
+	if (nic->loopback) {
+		simnic_rsc_rx (nic, frame, len);
+	}
+
+	return 0;
+}
+
+static void simnic_usage (const char *prog)
+{
+	printf ("usage: %s [-f shm-file] [-s ivshmem-socket] [-l] [-v]\n", prog);
+	printf ("  -f  shared memory file backing simeth BAR (default %s)\n", \
+			SIMNIC_DEF_SHM_PATH);
+	printf ("  -s  ivshmem-server socket, to raise msi-x vectors of ivshmem-doorbell\n");
+	printf ("  -l  loopback, frames sent by the driver are received back\n");
+	printf ("  -v  verbose\n");
+}
 
 int main (int argc, char **argv)
 {
-	int ret = 0;
+	int ret = 0, opt, fd, work, q, loopback = 0;
+	const char *shm_path = SIMNIC_DEF_SHM_PATH, *irq_path = NULL;
+	struct stat st;
+	simnic_t nic;
 
 	printf ("simnic - SIMulated NIC engine\n");
 
+	while ((opt = getopt (argc, argv, "f:s:lvh")) != -1) {
+		switch (opt) {
+			case 'f': shm_path = optarg; break;
+			case 's': irq_path = optarg; break;
+			case 'l': loopback = 1; break;
+			case 'v': simnic_verbose = 1; break;
+			default: simnic_usage (argv[0]); return (opt == 'h') ? 0 : -EINVAL;
+		}
+	}
+
+	memset (&nic, 0, sizeof (nic));
+	nic.loopback = loopback;
+	nic.irq_sock = -1;
+	for (q = 0; q < SER_MAX_TXQS; q++) {
+		nic.txq[q].reg_base = SER_TX_DRING_QBASE (q);
+	}
+	for (q = 0; q < SER_MAX_QS; q++) {
+		nic.rxq[q].reg_base = SER_RX_DRING_QBASE (q);
+	}
+
+	fd = open (shm_path, O_RDWR);
+	if (fd < 0) {
+		perror (shm_path);
+		return -errno;
+	}
+	if (fstat (fd, &st) < 0) {
+		perror ("fstat");
+		ret = -errno;
+		goto do_close;
+	}
+	if (st.st_size < SIMNIC_BAR_SZ) {
+		simnic_err ("%s is %ld bytes, simeth needs %d\n", \
+				shm_path, (long)st.st_size, SIMNIC_BAR_SZ);
+		ret = -EINVAL;
+		goto do_close;
+	}
+
+	nic.bar_sz = SIMNIC_BAR_SZ;
+	nic.bar = mmap (NULL, nic.bar_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (nic.bar == MAP_FAILED) {
+		perror ("mmap");
+		ret = -errno;
+		goto do_close;
+	}
+
+	nic.frame = malloc (SIMNIC_MAX_FRAME_SZ);
+	nic.seg = malloc (SIMNIC_MAX_SEG_SZ);
+	if (!nic.frame || !nic.seg || simnic_rsc_init (&nic)) {
+		ret = -ENOMEM;
+		goto do_free;
+	}
+	if (simnic_irq_init (&nic, irq_path)) {
+		ret = -EIO;
+		goto do_free;
+	}
+
+	simnic_info ("checksum kernel: %s\n", simnic_csum_init ());
+
+	signal (SIGINT, simnic_sighandler);
+	signal (SIGTERM, simnic_sighandler);
+
+	while (we_live) {
+		work = 0;
+		for (q = 0; q < SER_MAX_TXQS; q++) {
+			work += simnic_tx_poll (&nic, nic.txq + q);
+		}
+		simnic_rsc_poll (&nic);
+		simnic_irq_poll (&nic);
+		simnic_irq_flush (&nic);
+		if (!work) {
+			usleep (SIMNIC_IDLE_USLEEP);
+		}
+	}
+
+	simnic_info ("wire: %lu pkts, %lu bytes\n", nic.wire_pkts, nic.wire_bytes);
+	simnic_info ("irqs: %lu\n", nic.n_irqs);
+
+do_free:
+	simnic_irq_fini (&nic);
+	simnic_rsc_fini (&nic);
+	free (nic.seg);
+	free (nic.frame);
+	munmap (nic.bar, nic.bar_sz);
+do_close:
+	close (fd);
+
 	return ret;
 }
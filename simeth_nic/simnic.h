@@ -0,0 +1,174 @@
+#ifndef __SIMNIC_H
+#define __SIMNIC_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "simeth_nic.h"
+#include "simeth_common.h"
+
+/* Shared memory backing the simeth BAR, see README for creating it */
+#define SIMNIC_DEF_SHM_PATH "/dev/shm/simeth_mem"
+
+/* Size of the shared BAR */
+#define SIMNIC_BAR_SZ SER_BAR_SZ
+
+/* Largest packet the engine gathers from a tx desc chain */
+#define SIMNIC_MAX_FRAME_SZ (128 * 1024)
+
+/* Largest frame the engine puts on the wire, e.g. a TSO segment */
+#define SIMNIC_MAX_SEG_SZ (32 * 1024)
+
+/* Max packets handled from a q in one engine poll, qs take turns */
+#define SIMNIC_POLL_BUDGET 64
+
+/* Max descs a received frame is scattered over */
+#define SIMNIC_RX_CHAIN_MAX 64
+
+/* Longest input rss hashes, ipv6 addrs and l4 ports */
+#define SIMNIC_RSS_TUPLE_MAX 36
+
+/* Tcp flows rsc merges at a time, and the largest frame it builds */
+#define SIMNIC_RSC_FLOWS 8
+#define SIMNIC_RSC_BUF_SZ (64 * 1024)
+
+/* Ivshmem peers and vectors per peer the engine keeps eventfds of */
+#define SIMNIC_IRQ_MAX_PEERS 8
+#define SIMNIC_IRQ_MAX_VECS SER_IRQ_MAX_VECS
+
+/* ivshmem-server protocol version we speak */
+#define SIMNIC_IVSHMEM_PROTO_VER 0
+
+/* Engine sleep when all qs are idle, in usecs */
+#define SIMNIC_IDLE_USLEEP 10
+
+extern int simnic_verbose;
+
+#define simnic_err(format, arg...) \
+	fprintf (stderr, "simnic: " format, ## arg)
+#define simnic_info(format, arg...) \
+	printf ("simnic: " format, ## arg)
+#define simnic_dbg(format, arg...) \
+	do { if (simnic_verbose) printf ("simnic: " format, ## arg); } while (0)
+
+/* engine side view of a desc ring, latched from the q registers */
+typedef struct simnic_q {
+	uint32_t            reg_base; /*SER_TX_DRING_QBASE/SER_RX_DRING_QBASE of this q*/
+	uint32_t            n_desc;
+	volatile simeth_desc_t *dring;
+
+	uint32_t            irq_frames; /*done since the q's vector was last signalled*/
+	uint64_t            irq_t0; /*usecs, first of those seen by simnic_irq_flush*/
+} simnic_q_t;
+
+typedef simnic_q_t simnic_txq_t;
+typedef simnic_q_t simnic_rxq_t;
+
+#define SIMNIC_ETH_HLEN            14
+#define SIMNIC_VLAN_HLEN           4
+#define SIMNIC_ETH_P_IP            0x0800
+#define SIMNIC_ETH_P_IPV6          0x86dd
+#define SIMNIC_ETH_P_8021Q         0x8100
+#define SIMNIC_ETH_P_8021AD        0x88a8
+
+/* L3/L4 header layout of a frame, see simnic_parse_hdrs */
+typedef struct simnic_hdrs {
+	uint16_t            l3_off;
+	uint16_t            l4_off;
+	uint16_t            l3_proto; /*ethertype, IPv4 or IPv6*/
+	uint8_t             l4_proto; /*IPPROTO_*, 0 if not known*/
+	uint8_t             is_frag; /*IPv4 fragment, no L4 header to look at*/
+} simnic_hdrs_t;
+
+/* a tcp flow being coalesced, see simnic_rsc.c; free if n_segs is 0 */
+typedef struct simnic_rsc_flow {
+	uint8_t             *buf; /*merged frame so far, SIMNIC_RSC_BUF_SZ*/
+	uint32_t            len;
+	uint32_t            hdr_len; /*eth + ip + tcp headers of every segment*/
+	uint32_t            mss; /*payload of the first segment*/
+	uint32_t            next_seq;
+	uint32_t            n_segs;
+	uint64_t            t_start; /*usecs, sent up SER_RSC_FLUSH_US later*/
+	simnic_hdrs_t       h;
+} simnic_rsc_flow_t;
+
+/* an ivshmem peer, e.g. the guest, and the eventfds of its vectors;
+ * free if id is -1 */
+typedef struct simnic_peer {
+	int64_t             id;
+	uint32_t            n_vecs;
+	int                 fd[SIMNIC_IRQ_MAX_VECS];
+} simnic_peer_t;
+
+/* simulated NIC engine context */
+typedef struct simnic {
+	uint8_t             *bar; /*mmap'd shared memory, i.e. simeth BAR*/
+	uint64_t            bar_sz;
+
+	simnic_txq_t        txq[SER_MAX_TXQS]; /*all polled, driver enables the ones it uses*/
+	simnic_rxq_t        rxq[SER_MAX_QS];
+
+	int                 loopback; /*wire frames come back in on the rx qs*/
+	simnic_rsc_flow_t   rsc[SIMNIC_RSC_FLOWS];
+
+	int                 irq_sock; /*ivshmem-server connection, -1 if none*/
+	int64_t             irq_self; /*our own peer id*/
+	simnic_peer_t       peer[SIMNIC_IRQ_MAX_PEERS];
+	int                 irq_pending; /*qs have frames done no irq was signalled for*/
+
+	uint8_t             *frame; /*scratch buffer tx chains are gathered into*/
+	uint8_t             *seg; /*scratch buffer TSO segments are built in*/
+
+	uint64_t            wire_pkts;
+	uint64_t            wire_bytes;
+	uint64_t            n_irqs;
+} simnic_t;
+
+/* register access helpers on the shared BAR */
+#define simnic_r32(nic, reg)       simeth_r32 ((nic)->bar + (reg))
+#define simnic_w32(nic, reg, val)  simeth_w32 ((nic)->bar + (reg), (val))
+#define simnic_r64(nic, reg)       simeth_r64 ((nic)->bar + (reg))
+#define simnic_w64(nic, reg, val)  simeth_w64 ((nic)->bar + (reg), (val))
+
+/* engine side counters in the SER_TX_STATS/SER_RX_STATS registers */
+#define simnic_stat_add(nic, reg, n) \
+	simnic_w64 ((nic), (reg), simnic_r64 ((nic), (reg)) + (n))
+
+/* engine must not look at desc contents before the tail that covers them */
+#define simnic_rmb() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+#define simnic_wmb() __atomic_thread_fence (__ATOMIC_RELEASE)
+
+uint64_t simnic_now_us (void);
+void *simnic_dev_ptr (simnic_t *nic, uint64_t dev_addr, uint32_t len);
+int simnic_q_latch (simnic_t *nic, simnic_q_t *q);
+int simnic_wire_xmit (simnic_t *nic, uint8_t *frame, uint32_t len);
+
+const char *simnic_csum_init (void);
+uint32_t simnic_csum_partial (const void *buf, uint32_t len, uint32_t sum);
+uint16_t simnic_csum_fold (uint32_t sum);
+
+int simnic_parse_hdrs (const uint8_t *frame, uint32_t len, simnic_hdrs_t *h);
+int simnic_l4_csum (uint8_t *frame, uint32_t len, const simnic_hdrs_t *h);
+void simnic_l3_fixup (uint8_t *frame, uint32_t len, const simnic_hdrs_t *h, uint16_t ip_id);
+uint32_t simnic_rx_csum (const uint8_t *frame, uint32_t len);
+
+int simnic_tx_poll (simnic_t *nic, simnic_txq_t *q);
+int simnic_rx_deliver (simnic_t *nic, const uint8_t *frame, uint32_t len, uint32_t opts2);
+
+int simnic_rsc_init (simnic_t *nic);
+void simnic_rsc_fini (simnic_t *nic);
+int simnic_rsc_rx (simnic_t *nic, const uint8_t *frame, uint32_t len);
+void simnic_rsc_poll (simnic_t *nic);
+
+int simnic_irq_init (simnic_t *nic, const char *path);
+void simnic_irq_fini (simnic_t *nic);
+void simnic_irq_poll (simnic_t *nic);
+void simnic_irq_mark (simnic_t *nic, simnic_q_t *q, uint32_t n_frames);
+void simnic_irq_flush (simnic_t *nic);
+
+uint32_t simnic_toeplitz (const uint8_t *key, const uint8_t *data, uint32_t len);
+uint32_t simnic_rss_pick (simnic_t *nic, const uint8_t *frame, uint32_t len, \
+		uint32_t *hash, uint32_t *flags);
+
+#endif /*__SIMNIC_H*/
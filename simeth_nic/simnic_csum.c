@@ -0,0 +1,136 @@
+/**
+ * simnic_csum.c
+ *
+ * Internet (ones' complement) checksum helpers of simnic engine.
+ * Sums are kept in host byte order over 16-bit words read as they lie in
+ * memory, so a folded result can be stored back into a header as is.
+ *
+ * Bulk of the data is summed as 32-bit words into 64-bit accumulators,
+ * which can't overflow for any frame size; on x86 this runs on SSE2 or
+ * AVX2 lanes, picked once at startup by simnic_csum_init.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMNIC_CSUM_X86 1
+#endif
+
+#include "simnic.h"
+
+/* Sum len bytes (a multiple of 4) as 32-bit words, returns a 64-bit sum */
+typedef uint64_t (*simnic_csum_add_fn) (const uint8_t *p, uint32_t len);
+
+static uint64_t _simnic_csum_add_scalar (const uint8_t *p, uint32_t len)
+{
+	uint64_t acc = 0;
+	uint32_t w32;
+
+	for (; len >= 4; p += 4, len -= 4) {
+		memcpy (&w32, p, 4);
+		acc += w32;
+	}
+
+	return acc;
+}
+
+#ifdef SIMNIC_CSUM_X86
+__attribute__ ((target ("sse2")))
+static uint64_t _simnic_csum_add_sse2 (const uint8_t *p, uint32_t len)
+{
+	__m128i zero = _mm_setzero_si128 ();
+	__m128i acc0 = zero, acc1 = zero, v;
+	uint64_t lanes[2];
+
+	/*each 32-bit word zero extended into a 64-bit lane, then added*/
+	for (; len >= 16; p += 16, len -= 16) {
+		v = _mm_loadu_si128 ((const __m128i *)p);
+		acc0 = _mm_add_epi64 (acc0, _mm_unpacklo_epi32 (v, zero));
+		acc1 = _mm_add_epi64 (acc1, _mm_unpackhi_epi32 (v, zero));
+	}
+
+	_mm_storeu_si128 ((__m128i *)lanes, _mm_add_epi64 (acc0, acc1));
+	return lanes[0] + lanes[1] + _simnic_csum_add_scalar (p, len);
+}
+
+__attribute__ ((target ("avx2")))
+static uint64_t _simnic_csum_add_avx2 (const uint8_t *p, uint32_t len)
+{
+	__m256i zero = _mm256_setzero_si256 ();
+	__m256i acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero, v0, v1;
+	uint64_t lanes[4];
+
+	/*two 32 byte loads per round keep both add ports busy*/
+	for (; len >= 64; p += 64, len -= 64) {
+		v0 = _mm256_loadu_si256 ((const __m256i *)p);
+		v1 = _mm256_loadu_si256 ((const __m256i *)(p + 32));
+		acc0 = _mm256_add_epi64 (acc0, _mm256_unpacklo_epi32 (v0, zero));
+		acc1 = _mm256_add_epi64 (acc1, _mm256_unpackhi_epi32 (v0, zero));
+		acc2 = _mm256_add_epi64 (acc2, _mm256_unpacklo_epi32 (v1, zero));
+		acc3 = _mm256_add_epi64 (acc3, _mm256_unpackhi_epi32 (v1, zero));
+	}
+
+	acc0 = _mm256_add_epi64 (_mm256_add_epi64 (acc0, acc1), \
+			_mm256_add_epi64 (acc2, acc3));
+	_mm256_storeu_si256 ((__m256i *)lanes, acc0);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + \
+		_simnic_csum_add_sse2 (p, len);
+}
+#endif /*SIMNIC_CSUM_X86*/
+
+static simnic_csum_add_fn _simnic_csum_add = _simnic_csum_add_scalar;
+
+/* Pick the widest checksum kernel this cpu runs, returns its name */
+const char *simnic_csum_init (void)
+{
+#ifdef SIMNIC_CSUM_X86
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2")) {
+		_simnic_csum_add = _simnic_csum_add_avx2;
+		return "avx2";
+	}
+	if (__builtin_cpu_supports ("sse2")) {
+		_simnic_csum_add = _simnic_csum_add_sse2;
+		return "sse2";
+	}
+#endif
+	_simnic_csum_add = _simnic_csum_add_scalar;
+	return "scalar";
+}
+
+/* Add len bytes at buf to a running 32-bit partial sum.
+ * buf is assumed to start at an even offset of the checksummed data */
+uint32_t simnic_csum_partial (const void *buf, uint32_t len, uint32_t sum)
+{
+	const uint8_t *p = buf;
+	uint64_t acc = sum;
+	uint16_t w16 = 0;
+
+	acc += _simnic_csum_add (p, len & ~3);
+	p += len & ~3;
+	len &= 3;
+
+	if (len >= 2) {
+		memcpy (&w16, p, 2);
+		acc += w16;
+		p += 2;
+		len -= 2;
+	}
+	if (len) { /*odd trailing byte, padded with a zero byte*/
+		w16 = 0;
+		memcpy (&w16, p, 1);
+		acc += w16;
+	}
+
+	while (acc >> 32) {
+		acc = (acc & 0xffffffff) + (acc >> 32);
+	}
+	return (uint32_t)acc;
+}
+
+/* Fold a 32-bit partial sum into the final 16-bit checksum */
+uint16_t simnic_csum_fold (uint32_t sum)
+{
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return (uint16_t)~sum;
+}
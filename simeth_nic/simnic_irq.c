@@ -0,0 +1,296 @@
+/**
+ * simnic_irq.c
+ *
+ * Interrupts of simnic. The engine is a client of the ivshmem-server the
+ * guest's ivshmem-doorbell device is attached to; the server hands every
+ * client the eventfds of every other client's vectors, and a write to one
+ * of them fires that msi-x vector in the guest. The driver tells which
+ * peer it is in SER_IRQ_PEER and which vector each q wants in the q's
+ * SER_DRING_IRQ_VEC. Qs count the frames they hand back, and at the end
+ * of each engine loop the vectors of qs due an irq are signalled, once
+ * each: a q is due right away, or with moderation set in its
+ * SER_DRING_ITR_USECS/FRAMES, once either limit is reached. A vector the
+ * driver masked (while its napi runs) isn't signalled, its qs stay due
+ * and are signalled once it's unmasked, so no wakeup is lost.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "simnic.h"
+
+/* Read one int64 message off the server socket, with the fd it carries if
+ * any; returns 1 for a message, 0 if there's none yet, -1 if the server
+ * is gone */
+static int _simnic_irq_recv (simnic_t *nic, int64_t *val, int *fd, int flags)
+{
+	char ctl[CMSG_SPACE (sizeof (int))];
+	struct iovec iov = { .iov_base = val, .iov_len = sizeof (*val) };
+	struct msghdr msg = {
+		.msg_iov = &iov, .msg_iovlen = 1,
+		.msg_control = ctl, .msg_controllen = sizeof (ctl),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t n;
+
+	*fd = -1;
+	n = recvmsg (nic->irq_sock, &msg, flags);
+	if (n < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : -1;
+	}
+	if (n != sizeof (*val)) {
+		return -1;
+	}
+
+	for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+		if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+			memcpy (fd, CMSG_DATA (cmsg), sizeof (int));
+		}
+	}
+
+	return 1;
+}
+
+static simnic_peer_t *_simnic_irq_peer (simnic_t *nic, int64_t id, int alloc)
+{
+	simnic_peer_t *free_peer = NULL;
+	uint32_t i;
+
+	for (i = 0; i < SIMNIC_IRQ_MAX_PEERS; i++) {
+		if (nic->peer[i].id == id) {
+			return nic->peer + i;
+		}
+		if (!free_peer && (nic->peer[i].id < 0)) {
+			free_peer = nic->peer + i;
+		}
+	}
+	if (alloc && free_peer) {
+		free_peer->id = id;
+		free_peer->n_vecs = 0;
+	}
+
+	return alloc ? free_peer : NULL;
+}
+
+static void _simnic_irq_peer_gone (simnic_peer_t *peer)
+{
+	while (peer->n_vecs) {
+		close (peer->fd[--peer->n_vecs]);
+	}
+	peer->id = -1;
+}
+
+/* Take in what the server announces: a peer's vector eventfds, one per
+ * message in vector order, or a peer leaving as its id without an fd */
+static void _simnic_irq_msg (simnic_t *nic, int64_t id, int fd)
+{
+	simnic_peer_t *peer;
+
+	if (id == nic->irq_self) {
+		if (fd >= 0) {
+			close (fd); /*our own vectors, nobody rings the engine*/
+		}
+		return;
+	}
+
+	if (fd < 0) {
+		peer = _simnic_irq_peer (nic, id, 0);
+		if (peer) {
+			simnic_info ("irq: peer %ld left\n", (long)id);
+			_simnic_irq_peer_gone (peer);
+		}
+		return;
+	}
+
+	peer = _simnic_irq_peer (nic, id, 1);
+	if (!peer || (peer->n_vecs == SIMNIC_IRQ_MAX_VECS)) {
+		simnic_err ("irq: no room for vector of peer %ld\n", (long)id);
+		close (fd);
+		return;
+	}
+	if (!peer->n_vecs) {
+		simnic_info ("irq: peer %ld joined\n", (long)id);
+	}
+	peer->fd[peer->n_vecs++] = fd;
+}
+
+/* Connect to the ivshmem-server at path and go through its greeting:
+ * protocol version, our peer id, then the shm fd. The engine maps the
+ * shm by path already, so that fd is only checked and closed */
+int simnic_irq_init (simnic_t *nic, const char *path)
+{
+	struct sockaddr_un sun = { .sun_family = AF_UNIX };
+	int64_t val;
+	int fd, i;
+
+	for (i = 0; i < SIMNIC_IRQ_MAX_PEERS; i++) {
+		nic->peer[i].id = -1;
+	}
+	nic->irq_self = -1;
+	nic->irq_sock = -1;
+	if (!path) {
+		return 0;
+	}
+
+	if (strlen (path) >= sizeof (sun.sun_path)) {
+		simnic_err ("irq: socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy (sun.sun_path, path);
+
+	nic->irq_sock = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (nic->irq_sock < 0) {
+		perror ("socket");
+		return -1;
+	}
+	if (connect (nic->irq_sock, (struct sockaddr *)&sun, sizeof (sun)) < 0) {
+		perror (path);
+		goto do_close;
+	}
+
+	if ((_simnic_irq_recv (nic, &val, &fd, 0) != 1) || (val != SIMNIC_IVSHMEM_PROTO_VER)) {
+		simnic_err ("irq: bad ivshmem-server protocol version\n");
+		goto do_close;
+	}
+	if ((_simnic_irq_recv (nic, &val, &fd, 0) != 1) || (val < 0)) {
+		simnic_err ("irq: no peer id from ivshmem-server\n");
+		goto do_close;
+	}
+	nic->irq_self = val;
+	if ((_simnic_irq_recv (nic, &val, &fd, 0) != 1) || (val != -1) || (fd < 0)) {
+		simnic_err ("irq: no shm fd from ivshmem-server\n");
+		goto do_close;
+	}
+	close (fd);
+
+	fcntl (nic->irq_sock, F_SETFL, fcntl (nic->irq_sock, F_GETFL) | O_NONBLOCK);
+	simnic_info ("irq: ivshmem peer %ld on %s\n", (long)nic->irq_self, path);
+
+	return 0;
+
+do_close:
+	close (nic->irq_sock);
+	nic->irq_sock = -1;
+	return -1;
+}
+
+void simnic_irq_fini (simnic_t *nic)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIMNIC_IRQ_MAX_PEERS; i++) {
+		if (nic->peer[i].id >= 0) {
+			_simnic_irq_peer_gone (nic->peer + i);
+		}
+	}
+	if (nic->irq_sock >= 0) {
+		close (nic->irq_sock);
+		nic->irq_sock = -1;
+	}
+}
+
+/* Pick up peers joining/leaving since the last engine loop */
+void simnic_irq_poll (simnic_t *nic)
+{
+	int64_t id;
+	int fd, ret;
+
+	if (nic->irq_sock < 0) {
+		return;
+	}
+
+	while ((ret = _simnic_irq_recv (nic, &id, &fd, MSG_DONTWAIT)) > 0) {
+		_simnic_irq_msg (nic, id, fd);
+	}
+	if (ret < 0) {
+		simnic_err ("irq: lost ivshmem-server, no more interrupts\n");
+		simnic_irq_fini (nic);
+	}
+}
+
+/* Head of q moved past n_frames more frames */
+void simnic_irq_mark (simnic_t *nic, simnic_q_t *q, uint32_t n_frames)
+{
+	q->irq_frames += n_frames;
+	nic->irq_pending = 1;
+}
+
+/* Vector bit of q if its moderation says it's due an irq and the vector
+ * isn't masked, else 0 */
+static uint64_t _simnic_irq_due (simnic_t *nic, simnic_q_t *q, uint64_t now, uint32_t cause)
+{
+	uint32_t vec, usecs, frames, c, n;
+
+	if (!q->irq_t0) {
+		q->irq_t0 = now;
+	}
+	usecs = simnic_r32 (nic, q->reg_base + SER_DRING_ITR_USECS);
+	frames = simnic_r32 (nic, q->reg_base + SER_DRING_ITR_FRAMES);
+	if (usecs && (!frames || (q->irq_frames < frames)) && (now - q->irq_t0 < usecs)) {
+		nic->irq_pending = 1; /*not yet, look again next loop*/
+		return 0;
+	}
+
+	vec = simnic_r32 (nic, q->reg_base + SER_DRING_IRQ_VEC);
+	if (vec >= SIMNIC_IRQ_MAX_VECS) {
+		q->irq_frames = 0;
+		q->irq_t0 = 0;
+		return 0;
+	}
+	if (simnic_r32 (nic, SER_IRQ_VEC_MASK (vec))) {
+		nic->irq_pending = 1;
+		return 0;
+	}
+
+	/*the cause word is ours alone, the driver acks in its own word*/
+	q->irq_frames = 0;
+	q->irq_t0 = 0;
+	c = simnic_r32 (nic, SER_IRQ_VEC_CAUSE (vec));
+	n = (SER_IRQ_CAUSE_CNT (c, cause) + 1) & 0xffff;
+	simnic_w32 (nic, SER_IRQ_VEC_CAUSE (vec), (c & ~(0xffffU << cause)) | (n << cause));
+
+	return 1ULL << vec;
+}
+
+/* Signal the vectors of qs due an irq on the driver's peer */
+void simnic_irq_flush (simnic_t *nic)
+{
+	uint64_t pending = 0, now, one = 1;
+	simnic_peer_t *peer;
+	uint32_t vec, q;
+
+	if (!nic->irq_pending) {
+		return;
+	}
+	nic->irq_pending = 0;
+	now = simnic_now_us ();
+	for (q = 0; q < SER_MAX_TXQS; q++) {
+		if (nic->txq[q].irq_frames) {
+			pending |= _simnic_irq_due (nic, nic->txq + q, now, SER_IRQ_CAUSE_TX);
+		}
+	}
+	for (q = 0; q < SER_MAX_QS; q++) {
+		if (nic->rxq[q].irq_frames) {
+			pending |= _simnic_irq_due (nic, nic->rxq + q, now, SER_IRQ_CAUSE_RX);
+		}
+	}
+	if (!pending || (nic->irq_sock < 0) || !(simnic_r32 (nic, SER_IRQ_CTRL) & SER_IRQ_EN)) {
+		return;
+	}
+
+	peer = _simnic_irq_peer (nic, simnic_r32 (nic, SER_IRQ_PEER), 0);
+	if (!peer) {
+		return;
+	}
+	for (vec = 0; pending; vec++, pending >>= 1) {
+		if ((pending & 1) && (vec < peer->n_vecs)) {
+			if (write (peer->fd[vec], &one, sizeof (one)) == sizeof (one)) {
+				nic->n_irqs++;
+			}
+		}
+	}
+}
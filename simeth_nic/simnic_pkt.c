@@ -0,0 +1,186 @@
+/**
+ * simnic_pkt.c
+ *
+ * Packet header parsing of simnic engine, shared by the offloads that
+ * need to find L3/L4 headers of a frame (TSO, checksums, ...).
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include "simnic.h"
+
+/* Find L3/L4 headers of an ethernet frame; IPv6 extension headers aren't
+ * walked, l4_proto's left 0 for them. Returns -1 for non-IP or runt frames */
+int simnic_parse_hdrs (const uint8_t *frame, uint32_t len, simnic_hdrs_t *h)
+{
+	uint32_t off = SIMNIC_ETH_HLEN - 2;
+	uint16_t proto;
+
+	memset (h, 0, sizeof (*h));
+
+	do {
+		if (off + 2 > len) return -1;
+		proto = (frame[off] << 8) | frame[off + 1];
+		off += 2;
+		if ((proto == SIMNIC_ETH_P_8021Q) || (proto == SIMNIC_ETH_P_8021AD)) {
+			off += SIMNIC_VLAN_HLEN - 2; /*skip tci, land on inner proto*/
+			continue;
+		}
+		break;
+	} while (1);
+
+	h->l3_off = off;
+
+	if (proto == SIMNIC_ETH_P_IP) {
+		struct iphdr iph;
+
+		if (off + sizeof (iph) > len) return -1;
+		memcpy (&iph, frame + off, sizeof (iph));
+		if ((iph.version != 4) || (iph.ihl < 5)) return -1;
+
+		h->l3_proto = proto;
+		h->l4_off = off + iph.ihl * 4;
+		h->is_frag = !!(ntohs (iph.frag_off) & (IP_MF | IP_OFFMASK));
+		if (!h->is_frag) {
+			h->l4_proto = iph.protocol;
+		}
+	} else if (proto == SIMNIC_ETH_P_IPV6) {
+		struct ip6_hdr ip6h;
+
+		if (off + sizeof (ip6h) > len) return -1;
+		memcpy (&ip6h, frame + off, sizeof (ip6h));
+
+		h->l3_proto = proto;
+		h->l4_off = off + sizeof (ip6h);
+		if ((ip6h.ip6_nxt == IPPROTO_TCP) || (ip6h.ip6_nxt == IPPROTO_UDP)) {
+			h->l4_proto = ip6h.ip6_nxt;
+		}
+	} else {
+		return -1;
+	}
+
+	if (h->l4_off > len) return -1;
+
+	return 0;
+}
+
+/* Partial sum of the pseudo header of an l4_len bytes tcp/udp segment */
+static uint32_t _simnic_pseudo_sum (const uint8_t *frame, const simnic_hdrs_t *h, uint32_t l4_len)
+{
+	uint32_t sum;
+	uint8_t ph[40];
+
+	/*pseudo header: addresses, then zero+proto and l4 length*/
+	if (h->l3_proto == SIMNIC_ETH_P_IP) {
+		memcpy (ph, frame + h->l3_off + 12, 8);
+		ph[8] = 0;
+		ph[9] = h->l4_proto;
+		ph[10] = l4_len >> 8;
+		ph[11] = l4_len & 0xff;
+		sum = simnic_csum_partial (ph, 12, 0);
+	} else {
+		memcpy (ph, frame + h->l3_off + 8, 32);
+		sum = simnic_csum_partial (ph, 32, 0);
+		memset (ph, 0, 8);
+		ph[2] = l4_len >> 8;
+		ph[3] = l4_len & 0xff;
+		ph[7] = h->l4_proto;
+		sum = simnic_csum_partial (ph, 8, sum);
+	}
+
+	return sum;
+}
+
+/* Fill the full L4 (TCP/UDP) checksum of a frame, pseudo header included;
+ * used when the engine rewrites L3/L4 headers itself, e.g. TSO segments */
+int simnic_l4_csum (uint8_t *frame, uint32_t len, const simnic_hdrs_t *h)
+{
+	uint32_t l4_len = len - h->l4_off;
+	uint32_t csum_off = (h->l4_proto == IPPROTO_TCP) ? 16 : 6;
+	uint16_t csum;
+
+	if ((h->l4_proto != IPPROTO_TCP) && (h->l4_proto != IPPROTO_UDP)) return -1;
+	if (h->l4_off + csum_off + 2 > len) return -1;
+
+	memset (frame + h->l4_off + csum_off, 0, 2);
+	csum = simnic_csum_fold (simnic_csum_partial (frame + h->l4_off, l4_len, \
+				_simnic_pseudo_sum (frame, h, l4_len)));
+	if ((h->l4_proto == IPPROTO_UDP) && !csum) {
+		csum = 0xffff; /*0 means no checksum for udp*/
+	}
+	memcpy (frame + h->l4_off + csum_off, &csum, 2);
+
+	return 0;
+}
+
+/* Fix up L3 length (and IPv4 id/checksum) of a frame cut out of a larger
+ * packet, e.g. a TSO segment; ip_id is only used for IPv4 */
+void simnic_l3_fixup (uint8_t *frame, uint32_t len, const simnic_hdrs_t *h, uint16_t ip_id)
+{
+	uint8_t *l3 = frame + h->l3_off;
+	uint16_t v16;
+
+	if (h->l3_proto == SIMNIC_ETH_P_IP) {
+		v16 = htons (len - h->l3_off);
+		memcpy (l3 + 2, &v16, 2);
+		v16 = htons (ip_id);
+		memcpy (l3 + 4, &v16, 2);
+		memset (l3 + 10, 0, 2);
+		v16 = simnic_csum_fold (simnic_csum_partial (l3, h->l4_off - h->l3_off, 0));
+		memcpy (l3 + 10, &v16, 2);
+	} else {
+		v16 = htons (len - h->l3_off - sizeof (struct ip6_hdr));
+		memcpy (l3 + 4, &v16, 2);
+	}
+}
+
+/* Verify ipv4 header and tcp/udp checksums of a received frame, returns
+ * the SER_DO2_RX_* status bits for its sop desc. Lengths come from the ip
+ * header, so ethernet padding of short frames isn't summed */
+uint32_t simnic_rx_csum (const uint8_t *frame, uint32_t len)
+{
+	const uint8_t *l3, *l4;
+	uint32_t st = 0, l3_len, l4_len, csum_off;
+	simnic_hdrs_t h;
+
+	if (simnic_parse_hdrs (frame, len, &h)) {
+		return 0;
+	}
+	l3 = frame + h.l3_off;
+
+	if (h.l3_proto == SIMNIC_ETH_P_IP) {
+		st |= SER_DO2_RX_L3CS;
+		if (!simnic_csum_fold (simnic_csum_partial (l3, h.l4_off - h.l3_off, 0))) {
+			st |= SER_DO2_RX_L3CS_OK;
+		}
+		l3_len = (l3[2] << 8) | l3[3];
+	} else {
+		l3_len = sizeof (struct ip6_hdr) + ((l3[4] << 8) | l3[5]);
+	}
+
+	if (h.is_frag || ((h.l4_proto != IPPROTO_TCP) && (h.l4_proto != IPPROTO_UDP)) || \
+			(h.l3_off + l3_len > len) || (h.l3_off + l3_len < h.l4_off)) {
+		return st;
+	}
+	l4 = frame + h.l4_off;
+	l4_len = h.l3_off + l3_len - h.l4_off;
+	csum_off = (h.l4_proto == IPPROTO_TCP) ? 16 : 6;
+	if (l4_len < csum_off + 2) {
+		return st;
+	}
+	if ((h.l4_proto == IPPROTO_UDP) && (h.l3_proto == SIMNIC_ETH_P_IP) && \
+			!l4[csum_off] && !l4[csum_off + 1]) {
+		return st; /*udp over ipv4 without a checksum*/
+	}
+
+	st |= SER_DO2_RX_L4CS;
+	if (!simnic_csum_fold (simnic_csum_partial (l4, l4_len, \
+					_simnic_pseudo_sum (frame, &h, l4_len)))) {
+		st |= SER_DO2_RX_L4CS_OK;
+	}
+
+	return st;
+}
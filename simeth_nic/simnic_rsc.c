@@ -0,0 +1,247 @@
+/**
+ * simnic_rsc.c
+ *
+ * Receive segment coalescing of simnic, sits between the wire and the rx
+ * engine. Back to back in-order tcp segments of a flow are merged into one
+ * frame, the same way gro would merge them: same addresses and ports,
+ * same ack and tcp options, only ACK (and a closing PSH) set, and no
+ * segment bigger than the first one. The merged frame gets its ip/tcp
+ * lengths and checksums fixed up and goes to the rx engine with the
+ * segment count and mss in the sop desc, so the driver can hand it up as
+ * a gso skb.
+ */
+
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/ip6.h>
+
+#include "simnic.h"
+
+#define SIMNIC_TCP_ACK 0x10
+#define SIMNIC_TCP_PSH 0x08
+
+static inline uint32_t _simnic_rd32 (const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* Length of a tcp segment that may be merged, from its ip header so any
+ * ethernet padding is dropped; 0 if it has to go up on its own */
+static uint32_t _simnic_rsc_seg_len (const uint8_t *frame, uint32_t len, const simnic_hdrs_t *h)
+{
+	const uint8_t *l3 = frame + h->l3_off, *th = frame + h->l4_off;
+	uint32_t tlen, thlen;
+	uint32_t ok = SER_DO2_RX_L4CS | SER_DO2_RX_L4CS_OK;
+
+	if (h->l3_proto == SIMNIC_ETH_P_IP) {
+		if (h->l4_off != h->l3_off + 20) {
+			return 0; /*ip options*/
+		}
+		tlen = h->l3_off + ((l3[2] << 8) | l3[3]);
+		ok |= SER_DO2_RX_L3CS | SER_DO2_RX_L3CS_OK;
+	} else {
+		tlen = h->l4_off + ((l3[4] << 8) | l3[5]);
+	}
+	if ((tlen > len) || (h->l4_off + 20 > tlen)) {
+		return 0;
+	}
+
+	thlen = (th[12] >> 4) * 4;
+	if ((thlen < 20) || (h->l4_off + thlen >= tlen)) {
+		return 0; /*no payload*/
+	}
+	if ((th[13] & ~SIMNIC_TCP_PSH) != SIMNIC_TCP_ACK) {
+		return 0;
+	}
+	/*merged frame gets fresh sums, don't let a bad segment hide in it*/
+	if ((simnic_rx_csum (frame, tlen) & ok) != ok) {
+		return 0;
+	}
+
+	return tlen;
+}
+
+/* Flow of a segment, matched on addresses and ports */
+static simnic_rsc_flow_t *_simnic_rsc_find (simnic_t *nic, const uint8_t *frame, const simnic_hdrs_t *h)
+{
+	uint32_t i, alen = (h->l3_proto == SIMNIC_ETH_P_IP) ? 8 : 32;
+	uint32_t aoff = (h->l3_proto == SIMNIC_ETH_P_IP) ? 12 : 8;
+	simnic_rsc_flow_t *f;
+
+	for (i = 0; i < SIMNIC_RSC_FLOWS; i++) {
+		f = nic->rsc + i;
+		if (f->n_segs && (f->h.l3_proto == h->l3_proto) && \
+				!memcmp (f->buf + f->h.l3_off + aoff, frame + h->l3_off + aoff, alen) && \
+				!memcmp (f->buf + f->h.l4_off, frame + h->l4_off, 4)) {
+			return f;
+		}
+	}
+
+	return NULL;
+}
+
+static void _simnic_rsc_flush (simnic_t *nic, simnic_rsc_flow_t *f)
+{
+	uint32_t opts2 = 0;
+	uint16_t ip_id;
+
+	if (f->n_segs > 1) {
+		memcpy (&ip_id, f->buf + f->h.l3_off + 4, 2);
+		simnic_l3_fixup (f->buf, f->len, &f->h, ntohs (ip_id));
+		simnic_l4_csum (f->buf, f->len, &f->h);
+		opts2 = SER_DO2_RX_RSC_CNT (f->n_segs) | SER_DO2_RX_MSS (f->mss);
+	}
+	simnic_rx_deliver (nic, f->buf, f->len, opts2);
+	f->n_segs = 0;
+}
+
+/* Append a segment to its flow, returns -1 if it doesn't continue it */
+static int _simnic_rsc_merge (simnic_t *nic, simnic_rsc_flow_t *f, const uint8_t *frame, \
+		uint32_t tlen, uint32_t max_len)
+{
+	const uint8_t *th = frame + f->h.l4_off, *fth = f->buf + f->h.l4_off;
+	const uint8_t *l3 = frame + f->h.l3_off, *fl3 = f->buf + f->h.l3_off;
+	uint32_t payload = tlen - f->hdr_len;
+
+	if ((_simnic_rd32 (th + 4) != f->next_seq) || memcmp (th + 8, fth + 8, 4) || \
+			((th[12] >> 4) != (fth[12] >> 4)) || \
+			memcmp (th + 20, fth + 20, f->hdr_len - f->h.l4_off - 20)) {
+		return -1; /*out of order, new ack or different options*/
+	}
+	if (f->h.l3_proto == SIMNIC_ETH_P_IP) {
+		if ((l3[1] != fl3[1]) || (l3[8] != fl3[8])) {
+			return -1; /*tos, ttl*/
+		}
+	} else if (memcmp (l3, fl3, 4) || (l3[7] != fl3[7])) {
+		return -1; /*traffic class, flow label, hop limit*/
+	}
+	if ((payload > f->mss) || (f->len + payload > max_len) || \
+			(f->n_segs == SER_DO2_RX_RSC_CNT_MAX)) {
+		return -1;
+	}
+
+	memcpy (f->buf + f->len, frame + f->hdr_len, payload);
+	f->len += payload;
+	f->next_seq += payload;
+	f->n_segs++;
+	f->buf[f->h.l4_off + 13] |= th[13]; /*PSH of the last one*/
+	memcpy (f->buf + f->h.l4_off + 14, th + 14, 2); /*latest window*/
+
+	/*a short or pushed segment ends the burst, gro would stop here too*/
+	if ((th[13] & SIMNIC_TCP_PSH) || (payload < f->mss)) {
+		_simnic_rsc_flush (nic, f);
+	}
+
+	return 0;
+}
+
+/* Take a frame off the wire, coalescing it if rsc is on */
+int simnic_rsc_rx (simnic_t *nic, const uint8_t *frame, uint32_t len)
+{
+	uint32_t i, tlen, max_len;
+	simnic_rsc_flow_t *f, *oldest;
+	simnic_hdrs_t h;
+
+	if (!(simnic_r32 (nic, SER_RSC_CTRL) & SER_RSC_EN)) {
+		for (i = 0; i < SIMNIC_RSC_FLOWS; i++) {
+			if (nic->rsc[i].n_segs) {
+				_simnic_rsc_flush (nic, nic->rsc + i);
+			}
+		}
+		return simnic_rx_deliver (nic, frame, len, 0);
+	}
+
+	if (simnic_parse_hdrs (frame, len, &h) || (h.l4_proto != IPPROTO_TCP) || \
+			(h.l3_off != SIMNIC_ETH_HLEN)) {
+		return simnic_rx_deliver (nic, frame, len, 0);
+	}
+
+	max_len = simnic_r32 (nic, SER_RSC_MAX_LEN);
+	if (max_len > SIMNIC_RSC_BUF_SZ) {
+		max_len = SIMNIC_RSC_BUF_SZ;
+	}
+
+	f = _simnic_rsc_find (nic, frame, &h);
+	tlen = _simnic_rsc_seg_len (frame, len, &h);
+	if (f && tlen && !_simnic_rsc_merge (nic, f, frame, tlen, max_len)) {
+		return 0;
+	}
+	/*anything of the flow that isn't merged must not overtake it*/
+	if (f) {
+		_simnic_rsc_flush (nic, f);
+	}
+	if (!tlen || (tlen > max_len) || (frame[h.l4_off + 13] & SIMNIC_TCP_PSH)) {
+		return simnic_rx_deliver (nic, frame, len, 0);
+	}
+
+	/*start a new flow, making room by sending up the oldest one*/
+	for (i = 0, f = NULL, oldest = nic->rsc; i < SIMNIC_RSC_FLOWS; i++) {
+		if (!nic->rsc[i].n_segs) {
+			f = nic->rsc + i;
+			break;
+		}
+		if (nic->rsc[i].t_start < oldest->t_start) {
+			oldest = nic->rsc + i;
+		}
+	}
+	if (!f) {
+		f = oldest;
+		_simnic_rsc_flush (nic, f);
+	}
+
+	memcpy (f->buf, frame, tlen);
+	f->h = h;
+	f->len = tlen;
+	f->hdr_len = h.l4_off + (frame[h.l4_off + 12] >> 4) * 4;
+	f->mss = tlen - f->hdr_len;
+	f->next_seq = _simnic_rd32 (frame + h.l4_off + 4) + f->mss;
+	f->n_segs = 1;
+	f->t_start = simnic_now_us ();
+
+	return 0;
+}
+
+/* Send up flows held for longer than the flush timeout */
+void simnic_rsc_poll (simnic_t *nic)
+{
+	uint64_t now = 0;
+	uint32_t i, flush_us = 0;
+
+	for (i = 0; i < SIMNIC_RSC_FLOWS; i++) {
+		if (!nic->rsc[i].n_segs) {
+			continue;
+		}
+		if (!now) {
+			now = simnic_now_us ();
+			flush_us = simnic_r32 (nic, SER_RSC_FLUSH_US);
+		}
+		if (now - nic->rsc[i].t_start >= flush_us) {
+			_simnic_rsc_flush (nic, nic->rsc + i);
+		}
+	}
+}
+
+int simnic_rsc_init (simnic_t *nic)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIMNIC_RSC_FLOWS; i++) {
+		nic->rsc[i].buf = malloc (SIMNIC_RSC_BUF_SZ);
+		if (!nic->rsc[i].buf) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void simnic_rsc_fini (simnic_t *nic)
+{
+	uint32_t i;
+
+	for (i = 0; i < SIMNIC_RSC_FLOWS; i++) {
+		free (nic->rsc[i].buf);
+		nic->rsc[i].buf = NULL;
+	}
+}
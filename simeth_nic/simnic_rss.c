@@ -0,0 +1,80 @@
+/**
+ * simnic_rss.c
+ *
+ * Receive side scaling of simnic. Rx frames are hashed with the Toeplitz
+ * function over the ip addresses, and the tcp/udp ports when there are
+ * any, using the key the driver put in SER_RSS_KEY. The hash picks the
+ * frame's rxq through the SER_RSS_RETA indirection table and is written
+ * back in the sop desc, so the driver doesn't have to compute it again.
+ */
+
+#include <netinet/in.h>
+
+#include "simnic.h"
+
+/* Toeplitz hash of len bytes of data; key needs len + 4 bytes */
+uint32_t simnic_toeplitz (const uint8_t *key, const uint8_t *data, uint32_t len)
+{
+	uint32_t hash = 0, i, b;
+	/*32 bit window of the key, slides left by one bit per input bit*/
+	uint32_t win = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) | \
+		((uint32_t)key[2] << 8) | key[3];
+
+	for (i = 0; i < len; i++) {
+		for (b = 0; b < 8; b++) {
+			if (data[i] & (0x80 >> b)) {
+				hash ^= win;
+			}
+			win = (win << 1) | !!(key[i + 4] & (0x80 >> b));
+		}
+	}
+
+	return hash;
+}
+
+/* Pick the rxq of a frame, *hash and *flags get what goes in its sop desc */
+uint32_t simnic_rss_pick (simnic_t *nic, const uint8_t *frame, uint32_t len, \
+		uint32_t *hash, uint32_t *flags)
+{
+	uint8_t tuple[SIMNIC_RSS_TUPLE_MAX];
+	uint32_t n = 0, alen, q, n_qs;
+	simnic_hdrs_t h;
+
+	*hash = 0;
+	*flags = 0;
+
+	if (!(simnic_r32 (nic, SER_RSS_CTRL) & SER_RSS_EN) || \
+			simnic_parse_hdrs (frame, len, &h)) {
+		return 0;
+	}
+
+	/*src addr, dst addr, then src port, dst port as on the wire*/
+	if (h.l3_proto == SIMNIC_ETH_P_IP) {
+		alen = 4;
+		memcpy (tuple, frame + h.l3_off + 12, 2 * alen);
+	} else {
+		alen = 16;
+		memcpy (tuple, frame + h.l3_off + 8, 2 * alen);
+	}
+	n = 2 * alen;
+	*flags = SER_DF_RSS_L3;
+
+	if (!h.is_frag && ((h.l4_proto == IPPROTO_TCP) || (h.l4_proto == IPPROTO_UDP)) && \
+			(h.l4_off + 4 <= len)) {
+		memcpy (tuple + n, frame + h.l4_off, 4);
+		n += 4;
+		*flags = SER_DF_RSS_L4;
+	}
+
+	*hash = simnic_toeplitz (nic->bar + SER_RSS_KEY, tuple, n);
+
+	/*a stale entry past the enabled qs would drop the frame, the driver
+	 *may not have rewritten the table yet after its qs shrank*/
+	q = nic->bar[SER_RSS_RETA + (*hash & (SER_RSS_RETA_SZ - 1))];
+	n_qs = simnic_r32 (nic, SER_RSS_N_QS);
+	if (n_qs && (n_qs <= SER_MAX_QS) && (q >= n_qs)) {
+		q %= n_qs;
+	}
+
+	return q;
+}
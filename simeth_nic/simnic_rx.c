@@ -0,0 +1,126 @@
+/**
+ * simnic_rx.c
+ *
+ * Rx engine of simnic. Frames coming off the wire are scattered into the
+ * buffers of the descs the simeth driver posted on an rx q (head up to the
+ * tail it last rang), as a sop..eop chain. Each desc is handed back with
+ * SER_DF_OWN cleared and its byte count in opts1, then the q's head
+ * register moves past the chain. With header split on, the headers of
+ * tcp/udp frames go to the sop's header buffer instead and the desc
+ * buffers only get payload.
+ */
+
+#include <netinet/in.h>
+
+#include "simnic.h"
+
+/* Bytes of headers split off a frame, up to the end of its tcp/udp
+ * header; 0 to leave it whole (no l4 header, or no payload after it) */
+static uint32_t _simnic_rx_hds_len (const uint8_t *frame, uint32_t len)
+{
+	uint32_t hdr_len;
+	simnic_hdrs_t h;
+
+	if (simnic_parse_hdrs (frame, len, &h)) {
+		return 0;
+	}
+	if ((h.l4_proto == IPPROTO_TCP) && (h.l4_off + 20 <= len)) {
+		hdr_len = h.l4_off + (frame[h.l4_off + 12] >> 4) * 4;
+	} else if ((h.l4_proto == IPPROTO_UDP) && (h.l4_off + 8 <= len)) {
+		hdr_len = h.l4_off + 8;
+	} else {
+		return 0;
+	}
+
+	return ((hdr_len < len) && (hdr_len <= SER_HDS_HDR_SZ)) ? hdr_len : 0;
+}
+
+/* Write a frame into the descs posted on the rxq rss picks for it, opts2
+ * bits from earlier stages (rsc) go in its sop; returns 0 if delivered */
+int simnic_rx_deliver (simnic_t *nic, const uint8_t *frame, uint32_t len, uint32_t opts2)
+{
+	uint32_t dh, dt, n_avail, n, i, idx, off, blen, hash, rss_flags, csum_st, hdr_len = 0;
+	volatile simeth_desc_t *rxd;
+	uint32_t dlen[SIMNIC_RX_CHAIN_MAX];
+	simnic_rxq_t *q;
+	uint8_t *buf, *hdr = NULL;
+
+	simnic_stat_add (nic, SER_RX_STATS_PKT_ALL, 1);
+
+	q = nic->rxq + (simnic_rss_pick (nic, frame, len, &hash, &rss_flags) % SER_MAX_QS);
+	if (simnic_q_latch (nic, q)) {
+		goto do_drop;
+	}
+
+	dh = simnic_r32 (nic, q->reg_base + SER_DRING_HEAD);
+	dt = simnic_r32 (nic, q->reg_base + SER_DRING_TAIL);
+	if ((dh >= q->n_desc) || (dt >= q->n_desc)) {
+		goto do_drop;
+	}
+	n_avail = (dt + q->n_desc - dh) % q->n_desc;
+	/*descs up to tail are valid once we've seen the tail*/
+	simnic_rmb ();
+
+	if (simnic_r32 (nic, SER_HDS_CTRL) & SER_HDS_EN) {
+		hdr_len = _simnic_rx_hds_len (frame, len);
+		if (hdr_len) {
+			hdr = simnic_dev_ptr (nic, simnic_r32 (nic, q->reg_base + SER_DRING_HDR_PA) + \
+					dh * SER_HDS_HDR_SZ, SER_HDS_HDR_SZ);
+			hdr_len = hdr ? hdr_len : 0;
+		}
+	}
+
+	/*scatter the frame, past any split headers, over as many posted
+	 *buffers as it takes*/
+	for (n = 0, off = hdr_len, idx = dh; off < len; n++) {
+		if ((n == n_avail) || (n == SIMNIC_RX_CHAIN_MAX)) {
+			simnic_dbg ("rxq@0x%x no room for %u bytes\n", q->reg_base, len);
+			goto do_drop;
+		}
+		rxd = q->dring + idx;
+		blen = rxd->opts1 & SER_DF_LEN_MASK;
+		buf = simnic_dev_ptr (nic, ((uint64_t)rxd->buf_pa_hi << 32) | rxd->buf_pa_lo, blen);
+		if (!(rxd->opts1 & SER_DF_OWN) || !buf || !blen) {
+			simnic_dbg ("rxq@0x%x desc %u: bad opts1 0x%08x\n", \
+					q->reg_base, idx, rxd->opts1);
+			goto do_drop;
+		}
+		dlen[n] = (len - off < blen) ? len - off : blen;
+		memcpy (buf, frame + off, dlen[n]);
+		off += dlen[n];
+		idx = (idx + 1 == q->n_desc) ? 0 : idx + 1;
+	}
+
+	if (hdr_len) {
+		memcpy (hdr, frame, hdr_len);
+	}
+	csum_st = simnic_rx_csum (frame, len) | opts2;
+
+	/*buffers before descs, and sop last: once the driver sees the sop
+	 *handed back, the rest of the chain is there too*/
+	simnic_wmb ();
+	for (i = n; i--; ) {
+		idx = (dh + i) % q->n_desc;
+		q->dring[idx].opts2 = (i == 0) ? csum_st : 0;
+		if (i == 0) {
+			q->dring[idx].buf_pa_hi = hash;
+			if (hdr_len) {
+				q->dring[idx].buf_pa_lo = hdr_len;
+			}
+		}
+		q->dring[idx].opts1 = dlen[i] | ((i == n - 1) ? SER_DF_EOP : 0) | \
+			((i == 0) ? SER_DF_SOP | rss_flags | (hdr_len ? SER_DF_HDS : 0) : 0);
+	}
+
+	simnic_wmb ();
+	simnic_w32 (nic, q->reg_base + SER_DRING_HEAD, (dh + n) % q->n_desc);
+	simnic_irq_mark (nic, q, 1);
+
+	simnic_stat_add (nic, SER_RX_STATS_PKT_SENT, 1);
+	simnic_stat_add (nic, SER_RX_STATS_BYTES, len);
+	return 0;
+
+do_drop:
+	simnic_stat_add (nic, SER_RX_STATS_PKT_ERR, 1);
+	return -1;
+}
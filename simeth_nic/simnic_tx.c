@@ -0,0 +1,227 @@
+/**
+ * simnic_tx.c
+ *
+ * Tx engine of simnic. Consumes the tx desc ring the simeth driver fills,
+ * gathers each sop..eop desc chain into a single frame and puts it on the
+ * wire, then hands the descs back by clearing SER_DF_OWN and moving the
+ * q's head register up to the tail the driver last rang.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "simnic.h"
+
+#define SIMNIC_TCP_FIN 0x01
+#define SIMNIC_TCP_PSH 0x08
+#define SIMNIC_TCP_CWR 0x80
+
+/* Gather the desc chain starting at dh into nic->frame, sop's opts2 goes
+ * to *sop_opts2. Returns the number of descs in the chain, 0 if the chain's
+ * not fully posted yet. A malformed chain is still consumed, with *bad set */
+static uint32_t _simnic_tx_gather (simnic_t *nic, simnic_txq_t *q, \
+		uint32_t dh, uint32_t n_avail, uint32_t *frame_len, \
+		uint32_t *sop_opts1, uint32_t *sop_opts2, int *bad)
+{
+	volatile simeth_desc_t *txd;
+	uint32_t opts1, len, n = 0, frag_cnt = 0, total = 0;
+	uint64_t pa;
+	void *buf;
+
+	*bad = 0;
+
+	do {
+		if (n == n_avail) {
+			return 0;
+		}
+
+		txd = q->dring + dh;
+		opts1 = txd->opts1;
+		len = opts1 & SER_DF_LEN_MASK;
+
+		if (!(opts1 & SER_DF_OWN) || \
+				(!n && !(opts1 & SER_DF_SOP)) || (n && (opts1 & SER_DF_SOP))) {
+			simnic_dbg ("txq@0x%x desc %u: bad opts1 0x%08x\n", \
+					q->reg_base, dh, opts1);
+			*bad = 1;
+		}
+		if (!n) {
+			frag_cnt = SER_DF_FRAG_CNT_GET (opts1);
+			*sop_opts1 = opts1;
+			*sop_opts2 = txd->opts2;
+		}
+
+		pa = ((uint64_t)txd->buf_pa_hi << 32) | txd->buf_pa_lo;
+		buf = simnic_dev_ptr (nic, pa, len);
+		if (!buf || (total + len > SIMNIC_MAX_FRAME_SZ)) {
+			simnic_dbg ("txq@0x%x desc %u: bad buf pa 0x%lx len %u\n", \
+					q->reg_base, dh, pa, len);
+			*bad = 1;
+		}
+
+		if (!*bad) {
+			memcpy (nic->frame + total, buf, len);
+			total += len;
+		}
+
+		n++;
+		dh = (dh + 1 == q->n_desc) ? 0 : dh + 1;
+	} while (!(opts1 & SER_DF_EOP));
+
+	if (frag_cnt && (frag_cnt != n)) {
+		simnic_dbg ("txq@0x%x chain of %u descs, sop says %u\n", \
+				q->reg_base, n, frag_cnt);
+		*bad = 1;
+	}
+
+	*frame_len = total;
+	return n;
+}
+
+/* Cut a TSO super-packet into mss sized tcp frames and put them on the
+ * wire; each gets its own seq, IP length/id and checksums */
+static int _simnic_tx_tso (simnic_t *nic, uint8_t *frame, uint32_t len, uint32_t opts2)
+{
+	uint32_t mss = SER_DO2_MSS_GET (opts2);
+	uint32_t l4_off = SER_DO2_L4OFF_GET (opts2);
+	uint32_t hdr_len = l4_off + SER_DO2_L4HLEN_GET (opts2);
+	uint32_t off, plen, seg_len, seq0, seq;
+	uint16_t ip_id0 = 0, n_seg = 0;
+	uint8_t *seg = nic->seg;
+	uint8_t flags;
+	simnic_hdrs_t h;
+
+	if (simnic_parse_hdrs (frame, len, &h) || (h.l4_proto != IPPROTO_TCP) || \
+			(h.l4_off != l4_off) || !mss || (hdr_len >= len) || \
+			(hdr_len + mss > SIMNIC_MAX_SEG_SZ)) {
+		simnic_dbg ("tso: bad super-packet, len %u mss %u hdr_len %u\n", \
+				len, mss, hdr_len);
+		return -1;
+	}
+
+	memcpy (&seq0, frame + l4_off + 4, 4);
+	seq0 = ntohl (seq0);
+	flags = frame[l4_off + 13];
+	if (h.l3_proto == SIMNIC_ETH_P_IP) {
+		memcpy (&ip_id0, frame + h.l3_off + 4, 2);
+		ip_id0 = ntohs (ip_id0);
+	}
+
+	for (off = hdr_len; off < len; off += plen, n_seg++) {
+		plen = (len - off < mss) ? (len - off) : mss;
+		seg_len = hdr_len + plen;
+
+		memcpy (seg, frame, hdr_len);
+		memcpy (seg + hdr_len, frame + off, plen);
+
+		seq = htonl (seq0 + (off - hdr_len));
+		memcpy (seg + l4_off + 4, &seq, 4);
+		seg[l4_off + 13] = flags;
+		if (off + plen < len) { /*fin/psh only on the last one*/
+			seg[l4_off + 13] &= ~(SIMNIC_TCP_FIN | SIMNIC_TCP_PSH);
+		}
+		if (n_seg) { /*cwr only on the first one*/
+			seg[l4_off + 13] &= ~SIMNIC_TCP_CWR;
+		}
+
+		simnic_l3_fixup (seg, seg_len, &h, ip_id0 + n_seg);
+		simnic_l4_csum (seg, seg_len, &h);
+
+		if (simnic_wire_xmit (nic, seg, seg_len)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/* Fill in the csum the driver left partial: sum csum_start..end, seeded
+ * by the pseudo header sum already at csum_start + csum_off */
+static int _simnic_tx_csum (uint8_t *frame, uint32_t len, uint32_t opts2)
+{
+	uint32_t start = SER_DO2_CSUM_START_GET (opts2);
+	uint32_t off = start + SER_DO2_CSUM_OFF_GET (opts2);
+	simnic_hdrs_t h;
+	uint16_t csum;
+
+	if ((start >= len) || (off + 2 > len)) {
+		simnic_dbg ("csum: start %u off %u beyond len %u\n", start, off, len);
+		return -1;
+	}
+
+	csum = simnic_csum_fold (simnic_csum_partial (frame + start, len - start, 0));
+	if (!csum && !simnic_parse_hdrs (frame, len, &h) && \
+			(h.l4_proto == IPPROTO_UDP) && (h.l4_off == start)) {
+		csum = 0xffff; /*0 means no checksum for udp*/
+	}
+	memcpy (frame + off, &csum, 2);
+
+	return 0;
+}
+
+/* Put a gathered tx packet on the wire, applying offloads asked for */
+static int _simnic_tx_frame (simnic_t *nic, uint8_t *frame, uint32_t len, \
+		uint32_t opts1, uint32_t opts2)
+{
+	if (opts1 & SER_DF_TSO) {
+		return _simnic_tx_tso (nic, frame, len, opts2);
+	}
+
+	if ((opts1 & SER_DF_CSUM) && _simnic_tx_csum (frame, len, opts2)) {
+		return -1;
+	}
+
+	return simnic_wire_xmit (nic, frame, len);
+}
+
+/* Process up to SIMNIC_POLL_BUDGET tx packets of q, returns packets handled */
+int simnic_tx_poll (simnic_t *nic, simnic_txq_t *q)
+{
+	uint32_t dh, dt, n, i, frame_len, opts1, opts2;
+	int bad, done = 0;
+
+	if (simnic_q_latch (nic, q)) {
+		return 0;
+	}
+
+	dh = simnic_r32 (nic, q->reg_base + SER_DRING_HEAD);
+	dt = simnic_r32 (nic, q->reg_base + SER_DRING_TAIL);
+	if ((dh >= q->n_desc) || (dt >= q->n_desc)) {
+		return 0;
+	}
+	/*descs up to tail are valid once we've seen the tail*/
+	simnic_rmb ();
+
+	while ((dh != dt) && (done < SIMNIC_POLL_BUDGET)) {
+		n = _simnic_tx_gather (nic, q, dh, \
+				(dt + q->n_desc - dh) % q->n_desc, &frame_len, \
+				&opts1, &opts2, &bad);
+		if (!n) {
+			break;
+		}
+
+		simnic_stat_add (nic, SER_TX_STATS_PKT_ALL, 1);
+		if (!bad && (_simnic_tx_frame (nic, nic->frame, frame_len, opts1, opts2) == 0)) {
+			simnic_stat_add (nic, SER_TX_STATS_PKT_SENT, 1);
+			simnic_stat_add (nic, SER_TX_STATS_BYTES, frame_len);
+		} else {
+			simnic_stat_add (nic, SER_TX_STATS_PKT_ERR, 1);
+		}
+
+		/*all reads of the chain's buffers are done, give descs back*/
+		simnic_wmb ();
+		for (i = 0; i < n; i++) {
+			q->dring[dh].opts1 &= ~SER_DF_OWN;
+			dh = (dh + 1 == q->n_desc) ? 0 : dh + 1;
+		}
+		done++;
+	}
+
+	if (done) {
+		simnic_wmb ();
+		simnic_w32 (nic, q->reg_base + SER_DRING_HEAD, dh);
+		simnic_irq_mark (nic, q, done);
+	}
+
+	return done;
+}